@@ -0,0 +1,96 @@
+// implementation code for Animation class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Animation.hpp"
+
+// other classes used directly in the implementation
+#include "Object.hpp"
+
+// system includes
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// read frame lines
+bool
+Animation::read(std::istream &in, int objects)
+{
+    frames.clear();
+    int count = 0;          // copies of the last frame still to make
+    int number = 0;
+    for(std::string line; std::getline(in, line); ) {
+        ++number;
+        std::istringstream words(line);
+        std::string token;
+        if (!(words >> token) || token[0] == '#')
+            continue;
+
+        bool ok = true;
+        if (token == "frame") {
+            for(; count > 1; --count)
+                frames.push_back(frames.back());
+            if (!(words >> count)) {
+                count = 1;
+                words.clear();
+            }
+            ok = count > 0;
+            frames.push_back(Frame());
+        }
+        else if (frames.empty())
+            ok = false;     // everything else belongs to a frame
+        else {
+            Frame &frame = frames.back();
+            if (token == "move") {
+                Move move;
+                ok = words >> move.object && move.object >= 0 && move.object < objects &&
+                    move.t.parse(words);
+                frame.moves.push_back(move);
+            }
+            else if (token == "eyep")
+                ok = frame.setEye = bool(words >> frame.camera.eye);
+            else if (token == "lookp")
+                ok = frame.setLook = bool(words >> frame.camera.look);
+            else if (token == "up")
+                ok = frame.setUp = bool(words >> frame.camera.up);
+            else if (token == "fov")
+                ok = frame.setFov = bool(words >> frame.camera.xfov >> frame.camera.yfov);
+            else
+                ok = false;
+        }
+
+        // nothing left over but a comment
+        if (ok && words >> token)
+            ok = token[0] == '#';
+        if (!ok) {
+            std::cerr << "Can't read animation line " << number << ": " << line << '\n';
+            return false;
+        }
+    }
+    for(; count > 1; --count)
+        frames.push_back(frames.back());
+    return !frames.empty();
+}
+
+// move objects and camera for frame f
+void
+Animation::apply(int f, World &world, std::vector<int> &moved) const
+{
+    const Frame &frame = frames[f];
+    moved.clear();
+    for(auto &move : frame.moves) {
+        world.objects.objects[move.object]->move(move.t);
+        moved.push_back(move.object);
+    }
+    std::sort(moved.begin(), moved.end());
+    moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
+
+    if (frame.setEye) world.camera.eye = frame.camera.eye;
+    if (frame.setLook) world.camera.look = frame.camera.look;
+    if (frame.setUp) world.camera.up = frame.camera.up;
+    if (frame.setFov) {
+        world.camera.xfov = frame.camera.xfov;
+        world.camera.yfov = frame.camera.yfov;
+    }
+}
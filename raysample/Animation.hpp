@@ -0,0 +1,46 @@
+// frames of an animation: objects and camera moving over a scene
+#ifndef ANIMATION_HPP
+#define ANIMATION_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Transform.hpp"
+#include "World.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <istream>
+
+// changes to make before each frame, read from a file of lines like
+//   frame [count]                       start a frame, repeated count times
+//   move object [translate x y z] [rotate x y z degrees] [scale s]
+//   eyep x y z, lookp x y z, up x y z, fov x y
+// moves are relative to where the object is, so a frame repeated count
+// times keeps moving it; objects are numbered from 0 in scene file order,
+// with an instance as one object; camera changes last until changed again
+class Animation {
+public: // public types
+    struct Move {
+        int object;
+        Transform t;
+    };
+    struct Frame {
+        std::vector<Move> moves;
+        Camera camera;
+        bool setEye, setLook, setUp, setFov;
+        Frame() : setEye(false), setLook(false), setUp(false), setFov(false) {}
+    };
+
+public: // public data
+    std::vector<Frame> frames;
+
+public: // manipulators
+    // read frames for a scene of objects objects
+    // prints the line and returns false if something doesn't parse
+    bool read(std::istream &in, int objects);
+
+public: // computational members
+    // move world's objects and camera for frame f, listing the objects moved
+    void apply(int f, World &world, std::vector<int> &moved) const;
+};
+
+#endif
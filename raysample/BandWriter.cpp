@@ -0,0 +1,68 @@
+// implementation code for BandWriter class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "BandWriter.hpp"
+
+// system includes
+#include <chrono>
+
+// set up band ring
+BandWriter::BandWriter(FILE *_out, Image::Format _format, int _width, int _height,
+                       int _bandHeight, int tilesPerBand, int _window)
+    : out(_out), format(_format), width(_width), height(_height), bandHeight(_bandHeight),
+      nextBand(0), writing(false), writeTime(0)
+{
+    if (bandHeight < 1) bandHeight = 1;
+    bands = (height + bandHeight - 1) / bandHeight;
+    window = _window < 1 || _window > bands ? bands : _window;
+
+    ring.resize(size_t(window) * bandHeight * width * 3);
+    remaining.assign(bands, tilesPerBand);
+}
+
+// pixels for row y
+float (*BandWriter::row(int y))[3]
+{
+    int seq = sequence(y);
+    std::unique_lock<std::mutex> guard(lock);
+    room.wait(guard, [&]{ return seq < nextBand + window; });
+
+    size_t slotRow = size_t(seq % window) * bandHeight + y % bandHeight;
+    return (float (*)[3])(&ring[slotRow * width * 3]);
+}
+
+// one tile done, write complete bands
+void
+BandWriter::tileDone(int y)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    --remaining[sequence(y)];
+
+    // only one thread writes at a time; it rechecks for newly finished
+    // bands after each write, so nothing is missed
+    if (writing) return;
+    writing = true;
+
+    while (nextBand < bands && remaining[nextBand] == 0) {
+        int seq = nextBand;
+        int band = format == Image::PFM ? bands-1 - seq : seq;
+        guard.unlock();
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        // write without holding the lock, no one touches this slot until
+        // nextBand moves past it
+        int rows = band == bands-1 ? height - band*bandHeight : bandHeight;
+        Image::writeRows(out, format, &ring[size_t(seq % window) * bandHeight * width * 3],
+                         width, rows);
+        fflush(out);
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<float> elapsed = endTime - startTime;
+        guard.lock();
+        writeTime += elapsed.count();
+        ++nextBand;
+        room.notify_all();
+    }
+    writing = false;
+}
@@ -0,0 +1,66 @@
+// streaming ppm or pfm output, one horizontal band of tiles at a time
+#ifndef BANDWRITER_HPP
+#define BANDWRITER_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Image.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <stdio.h>
+
+// the image is a stack of bands, each one tile high
+// tiles render into a ring of window bands; as soon as every tile in the
+// oldest band is done, that band is written and its slot reused
+// tiles more than window bands ahead wait for a slot, so memory stays at
+// window bands no matter how large the image is
+// pixels stay in float radiance until written; PFM files are stored bottom
+// row first, so for PFM the bands are written bottom band first
+class BandWriter {
+private: // private data
+    FILE *out;                      // output file, pipe, or stdout
+    Image::Format format;           // PPM or PFM
+    int width, height;              // image size
+    int bandHeight, bands, window;  // rows per band, total bands, bands resident
+    std::vector<float> ring;        // window bands of rgb pixels
+    std::vector<int> remaining;     // tiles left in each band, in file order
+    int nextBand;                   // number of bands written
+    bool writing;                   // some thread is writing bands
+    float writeTime;                // seconds spent writing
+
+    std::mutex lock;
+    std::condition_variable room;   // signalled when a band is written
+
+public: // constructor
+    // write pixels of a width x height ppm or pfm image to out, after the
+    // header, which the caller writes first
+    // bands are bandHeight rows of tilesPerBand tiles, window of 0 for all
+    BandWriter(FILE *out, Image::Format format, int width, int height,
+               int bandHeight, int tilesPerBand, int window);
+
+public: // computational members
+    // pixels for row y, waiting until its band is within the window
+    // rows of the same band are contiguous
+    float (*row(int y))[3];
+
+    // one tile of the band containing row y is done
+    // writes any bands that are now complete, in order
+    void tileDone(int y);
+
+    // seconds spent writing bands, mostly while other threads trace
+    float writeSeconds() const { return writeTime; }
+
+    // number of bands resident at once
+    int resident() const { return window; }
+
+    // position in the file of the band containing row y, 0 for the first
+    // band written; tiles handed out in this order never wait long
+    int sequence(int y) const {
+        int band = y / bandHeight;
+        return format == Image::PFM ? bands-1 - band : band;
+    }
+};
+
+#endif
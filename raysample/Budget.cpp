@@ -0,0 +1,141 @@
+// implementation code for Budget class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Budget.hpp"
+
+// other classes used directly in the implementation
+#include "World.hpp"
+
+// system includes
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+
+// budget of seconds from start, less reserve, for pixels still to trace
+Budget::Budget(const World &world, float _seconds,
+               std::chrono::high_resolution_clock::time_point _start, float _reserve,
+               int _threads, long long _pixels)
+    : start(_start), seconds(_seconds), reserve(std::min(_reserve, _seconds)),
+      threads(std::max(_threads, 1)), pixelsLeft(_pixels)
+{
+    // full quality, then no anti-aliasing, then a short ray tree, then
+    // primary and shadow rays only
+    quality[0] = Quality(world);
+    quality[1] = Quality(world.maxdepth, world.cutoff, 1);
+    quality[2] = Quality(std::min(world.maxdepth, 2), std::max(world.cutoff, 0.1f), 1);
+    quality[3] = Quality(0, world.cutoff, 1);
+
+    for(int l=0; l < LEVELS; ++l) {
+        time[l] = 0;
+        pixels[l] = 0;
+        tiles[l] = 0;
+    }
+}
+
+// estimated thread seconds per pixel at level
+// levels without a measurement of their own guess at half the time of the
+// level above, or twice the time of the level below
+double
+Budget::perPixel(int level) const
+{
+    if (pixels[level] > 0)
+        return time[level] / double(pixels[level]);
+
+    for(int d=1; d < LEVELS-1; ++d) {
+        if (level - d >= 0 && pixels[level - d] > 0)
+            return time[level - d] / double(pixels[level - d]) / double(1 << d);
+        if (level + d < LEVELS-1 && pixels[level + d] > 0)
+            return time[level + d] / double(pixels[level + d]) * double(1 << d);
+    }
+    return -1;
+}
+
+// quality level for a tile of pixels about to start
+int
+Budget::choose(int tilePixels)
+{
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    double left = seconds - reserve - elapsed.count();
+
+    std::lock_guard<std::mutex> hold(lock);
+    int level = LEVELS-1;
+    if (left > 0) {
+        // leave a tenth of the time for tiles already in flight
+        for(level=0; level < LEVELS-2; ++level) {
+            double cost = perPixel(level);
+            if (cost < 0 || cost * double(pixelsLeft) / threads <= 0.9 * left)
+                break;
+        }
+    }
+    pixelsLeft -= tilePixels;
+    ++tiles[level];
+    return level;
+}
+
+// a tile of pixels at level took seconds of one thread
+void
+Budget::finish(int level, int tilePixels, float tileSeconds)
+{
+    std::lock_guard<std::mutex> hold(lock);
+    time[level] += tileSeconds;
+    pixels[level] += tilePixels;
+}
+
+// print the settings and use of each level, and per-view tile maps
+void
+Budget::stats(std::ostream &out, const TileList &tileList, const std::vector<int> &levels,
+              int views, const Tile &region, int tileSize)
+{
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    out << "Budget " << 1000 * seconds << " ms from the job's start, with "
+        << 1000 * reserve << " ms kept to write, tiles done in "
+        << 1000 * elapsed.count() << " ms\n";
+    for(int l=0; l < LEVELS; ++l) {
+        out << "  level " << l;
+        if (traced(l))
+            out << " (maxdepth " << quality[l].maxdepth << ", cutoff "
+                << quality[l].cutoff << ", " << quality[l].samples << 'x'
+                << quality[l].samples << " samples)";
+        else
+            out << " (background, not traced)";
+        out << ": " << tiles[l] << " tiles";
+        if (pixels[l] > 0 && traced(l))
+            out << ", " << 1e6 * time[l] / double(pixels[l]) << " us/pixel";
+        out << '\n';
+    }
+
+    // one character per tile: the level, or r if restored from a checkpoint
+    int columns = (region.width() + tileSize - 1) / tileSize;
+    int rows = (region.height() + tileSize - 1) / tileSize;
+    for(int v=0; v < views; ++v) {
+        if (views > 1)
+            out << "view " << v << ":\n";
+        std::vector<std::string> map(rows, std::string(columns, ' '));
+        for(size_t t=0; t < tileList.size(); ++t) {
+            const Tile &tile = tileList[t];
+            int level = levels[t*views + v];
+            map[(tile.y0 - region.y0) / tileSize][(tile.x0 - region.x0) / tileSize] =
+                level < 0 ? 'r' : char('0' + level);
+        }
+        for(auto &row : map)
+            out << "  " << row << '\n';
+    }
+}
+
+// parse a time like 250ms or 1.5s into seconds
+bool
+Budget::parse(const char *text, float &result)
+{
+    char *end;
+    double value = strtod(text, &end);
+    if (strcmp(end, "ms") == 0)
+        value /= 1000;
+    else if (*end != '\0' && strcmp(end, "s") != 0)
+        return false;
+    if (!(value > 0))
+        return false;
+    result = float(value);
+    return true;
+}
@@ -0,0 +1,85 @@
+// time budget for a render, trading quality for a deadline tile by tile
+#ifndef BUDGET_HPP
+#define BUDGET_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Sampler.hpp"
+#include "Tiles.hpp"
+
+// classes we only use by pointer or reference
+class World;
+
+// system includes necessary for the interface
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <ostream>
+
+// quality controller for a render that must finish by a deadline
+// the deadline counts from the start of the whole job, so parsing the scene
+// and building its acceleration structure come out of it, and time to
+// write the image is held back from it
+// each tile asks for a quality level as it starts: the best level whose
+// measured time per pixel, times the pixels not yet started, spread over
+// the threads, still fits in the time left; so the first tiles get full
+// quality and the rest degrade only as far as they have to
+// level 0 is the world's own settings; each later level drops
+// anti-aliasing, then shortens the ray tree, then traces no secondary
+// rays at all; the last level traces nothing and fills the tile with the
+// background, for tiles started after the deadline, so there is always a
+// whole image to write
+class Budget {
+public: // public constants
+    enum { LEVELS = 5 };            // including the background fill
+
+private: // private data
+    std::chrono::high_resolution_clock::time_point start;
+    float seconds;                  // from start to the deadline
+    float reserve;                  // of seconds, for writing the image
+    int threads;
+    Quality quality[LEVELS-1];      // settings for the traced levels
+
+    std::mutex lock;                // for everything below
+    long long pixelsLeft;           // in tiles not yet started
+    double time[LEVELS];            // thread seconds spent at each level
+    long long pixels[LEVELS];       // pixels finished at each level
+    int tiles[LEVELS];              // tiles started at each level
+
+public: // constructors
+    // budget of seconds from start, less reserve seconds to write the
+    // image, for pixels still to trace, with threads
+    Budget(const World &world, float seconds,
+           std::chrono::high_resolution_clock::time_point start, float reserve,
+           int threads, long long pixels);
+
+public: // computational members
+    // quality level for a tile of pixels about to start
+    int choose(int pixels);
+
+    // true if tiles at level are traced, false for the background fill
+    bool traced(int level) const { return level < LEVELS-1; }
+
+    // settings for a traced level
+    const Quality &settings(int level) const { return quality[level]; }
+
+    // a tile of pixels at level took seconds of one thread
+    void finish(int level, int pixels, float seconds);
+
+    // print the settings of each level, how many tiles used it, and for
+    // each view a map of the level used for each of tiles in region
+    // levels[t*views + v] is the level of tile t of view v, or -1 if the
+    // tile was restored from a checkpoint
+    void stats(std::ostream &out, const TileList &tiles, const std::vector<int> &levels,
+               int views, const Tile &region, int tileSize);
+
+    // parse a time like 250ms or 1.5s into seconds; plain numbers are seconds
+    // returns false if it isn't a positive time
+    static bool parse(const char *text, float &seconds);
+
+private: // internal helpers
+    // estimated thread seconds per pixel at level, from the measured levels
+    // returns a negative value if nothing has been measured yet
+    double perPixel(int level) const;
+};
+
+#endif
@@ -0,0 +1,694 @@
+// implementation code for Bvh class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Bvh.hpp"
+
+// other classes used directly in the implementation
+#include "Object.hpp"
+#include "Ray.hpp"
+#include "ThreadPool.hpp"
+
+// system includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+// surface area cost of visiting an internal node, relative to testing an object
+static const float NodeCost = 1.2f, ObjectCost = 1;
+
+// most subtrees gathered into one treelet
+// 7 finds a little lower cost, but searches about ten times the splits of 5
+static const int TreeletSize = 5;
+
+// traversal stack entries
+// the Morton tree is at most 62 levels deep: 30 bits of code and 32 of
+// object position to tell equal codes apart
+static const int StackSize = 64;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// start loading the cache line at p
+static inline void
+prefetch(const void *p)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(p);
+#elif FLOAT4_SSE
+    _mm_prefetch((const char*)p, _MM_HINT_T0);
+#endif
+}
+
+// about four ranges per thread, but no ranges shorter than 4096 items
+static int
+chunkCount(ThreadPool *pool, int n)
+{
+    return pool ? std::max(1, std::min(4*pool->size(), n/4096)) : 1;
+}
+
+// run body(chunk, first, last) on pool for each of chunks ranges covering [0,n)
+static void
+forChunks(ThreadPool *pool, int chunks, int n, const std::function<void(int,int,int)> &body)
+{
+    int size = (n + chunks - 1) / chunks;
+    auto range = [&](int c, int) {
+        int first = c*size, last = std::min(n, first + size);
+        if (first < last) body(c, first, last);
+    };
+    if (pool && chunks > 1)
+        pool->run(chunks, range);
+    else
+        for(int c=0; c < chunks; ++c)
+            range(c, 0);
+}
+
+// count of leading zero bits of a nonzero v
+static inline int
+leadingZeros(uint32_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_clz(v);
+#else
+    int n = 0;
+    for(; !(v & 0x80000000u); v <<= 1)
+        ++n;
+    return n;
+#endif
+}
+
+// spread the low 10 bits of v out to every third bit
+static inline uint32_t
+spreadBits(uint32_t v)
+{
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v <<  8)) & 0x0300F00F;
+    v = (v | (v <<  4)) & 0x030C30C3;
+    v = (v | (v <<  2)) & 0x09249249;
+    return v;
+}
+
+// common prefix length of the sort keys at positions i and j, or -1 if j
+// is out of range; equal codes are told apart by their positions
+static inline int
+commonPrefix(const uint32_t *codes, int n, int i, int j)
+{
+    if (j < 0 || j >= n) return -1;
+    if (codes[i] != codes[j])
+        return leadingZeros(codes[i] ^ codes[j]);
+    return 32 + leadingZeros(uint32_t(i ^ j));
+}
+
+// stable radix sort of codes, moving index along with them, 8 bits a pass
+// each chunk counts its digits, and a prefix sum over digits, then chunks,
+// gives each chunk its own place to scatter to
+static void
+radixSort(ThreadPool *pool, std::vector<uint32_t> &codes, std::vector<int> &index)
+{
+    int n = int(codes.size());
+    int chunks = chunkCount(pool, n);
+    std::vector<uint32_t> codesOut(n);
+    std::vector<int> indexOut(n);
+    std::vector<int> offsets(chunks * 256);
+
+    for(int shift=0; shift < 32; shift += 8) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        forChunks(pool, chunks, n, [&](int c, int first, int last) {
+            int *count = &offsets[c * 256];
+            for(int i=first; i < last; ++i)
+                ++count[(codes[i] >> shift) & 255];
+        });
+
+        int sum = 0;
+        for(int d=0; d < 256; ++d) {
+            for(int c=0; c < chunks; ++c) {
+                int count = offsets[c*256 + d];
+                offsets[c*256 + d] = sum;
+                sum += count;
+            }
+        }
+
+        forChunks(pool, chunks, n, [&](int c, int first, int last) {
+            int *next = &offsets[c * 256];
+            for(int i=first; i < last; ++i) {
+                int to = next[(codes[i] >> shift) & 255]++;
+                codesOut[to] = codes[i];
+                indexOut[to] = index[i];
+            }
+        });
+        codes.swap(codesOut);
+        index.swap(indexOut);
+    }
+}
+
+// half the surface area of a box
+static inline float
+halfArea(const float lo[3], const float hi[3])
+{
+    float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+    return dx*dy + dy*dz + dz*dx;
+}
+
+// distance along a ray from E with reciprocal direction invD where it
+// enters box lo-hi between near and far, or INFINITY if it misses
+// the exit is pushed out by a few rounding errors, so a ray grazing the
+// box still reaches objects that touch its sides
+static inline float
+entry(const float lo[3], const float hi[3], const float4 &E, const float4 &invD,
+      float near, float far)
+{
+    float4 t0 = (float4(lo[0], lo[1], lo[2]) - E) * invD;
+    float4 t1 = (float4(hi[0], hi[1], hi[2]) - E) * invD;
+    float4 tmin = min(t0, t1), tmax = max(t0, t1);
+    float enter = std::max(std::max(tmin[0], tmin[1]), std::max(tmin[2], near));
+    float exit = std::min(std::min(tmax[0], tmax[1]), tmax[2]) * 1.0000008f;
+    exit = std::min(exit, far);
+    return enter <= exit ? enter : INFINITY;
+}
+
+// rebuild for objects
+void
+Bvh::build(const std::vector<Object*> &objects, int treelets, ThreadPool *pool)
+{
+    auto startTime = Clock::now();
+    int n = int(objects.size());
+    nodes.clear();
+    depth = 0;
+    sortTime = emitTime = boundsTime = treeletTime = 0;
+    costBefore = costAfter = 0;
+    if (n == 0) return;
+    nodes.resize(2*n - 1);
+    int chunks = chunkCount(pool, n);
+
+    // object bounds, and the bounds of their centers
+    std::vector<Node> boxes(n);
+    std::vector<Node> centers(chunks);
+    forChunks(pool, chunks, n, [&](int c, int first, int last) {
+        Node &range = centers[c];
+        for(int k=0; k < 3; ++k) {
+            range.lo[k] = INFINITY;
+            range.hi[k] = -INFINITY;
+        }
+        for(int i=first; i < last; ++i) {
+            Vec3 lo, hi;
+            objects[i]->bounds(lo, hi);
+            for(int k=0; k < 3; ++k) {
+                boxes[i].lo[k] = lo[k];
+                boxes[i].hi[k] = hi[k];
+                float center = 0.5f * (lo[k] + hi[k]);
+                range.lo[k] = std::min(range.lo[k], center);
+                range.hi[k] = std::max(range.hi[k], center);
+            }
+            boxes[i].left = -1;
+            boxes[i].right = i;
+        }
+    });
+    float lo[3], scale[3];
+    for(int k=0; k < 3; ++k) {
+        float hi = -INFINITY;
+        lo[k] = INFINITY;
+        for(auto &range : centers) {
+            lo[k] = std::min(lo[k], range.lo[k]);
+            hi = std::max(hi, range.hi[k]);
+        }
+        scale[k] = hi > lo[k] ? 1023.99f / (hi - lo[k]) : 0;
+    }
+
+    // 30-bit Morton codes of the centers, sorted
+    std::vector<uint32_t> codes(n);
+    std::vector<int> index(n);
+    forChunks(pool, chunks, n, [&](int, int first, int last) {
+        for(int i=first; i < last; ++i) {
+            uint32_t q[3];
+            for(int k=0; k < 3; ++k) {
+                float center = 0.5f * (boxes[i].lo[k] + boxes[i].hi[k]);
+                q[k] = uint32_t(std::min(std::max((center - lo[k]) * scale[k], 0.f), 1023.f));
+            }
+            codes[i] = (spreadBits(q[0]) << 2) | (spreadBits(q[1]) << 1) | spreadBits(q[2]);
+            index[i] = i;
+        }
+    });
+    radixSort(pool, codes, index);
+    auto sortedTime = Clock::now();
+
+    // leaves in Morton order, and each internal node's range of leaves
+    // node i covers the longest run of keys starting or ending at i that
+    // share a longer prefix than i shares with its neighbor on the other
+    // side, and splits where that prefix ends
+    Node *leaves = &nodes[n-1];
+    parents.assign(2*n - 1, -1);
+    leafOf.resize(n);
+    forChunks(pool, chunks, n, [&](int, int first, int last) {
+        for(int i=first; i < last; ++i) {
+            leaves[i] = boxes[index[i]];
+            leafOf[index[i]] = n-1 + i;
+        }
+    });
+    const uint32_t *key = codes.data();
+    forChunks(pool, chunks, n-1, [&](int, int first, int last) {
+        for(int i=first; i < last; ++i) {
+            // direction of the range, and the prefix the range must beat
+            int d = commonPrefix(key, n, i, i+1) > commonPrefix(key, n, i, i-1) ? 1 : -1;
+            int minPrefix = commonPrefix(key, n, i, i-d);
+
+            // other end of the range, by doubling then binary search
+            int lmax = 2;
+            while (commonPrefix(key, n, i, i + lmax*d) > minPrefix)
+                lmax *= 2;
+            int l = 0;
+            for(int t = lmax/2; t >= 1; t /= 2)
+                if (commonPrefix(key, n, i, i + (l+t)*d) > minPrefix)
+                    l += t;
+            int j = i + l*d;
+
+            // split where the prefix shared by the whole range ends
+            int nodePrefix = commonPrefix(key, n, i, j);
+            int s = 0;
+            for(int divisor=2; ; divisor *= 2) {
+                int t = (l + divisor - 1) / divisor;
+                if (commonPrefix(key, n, i, i + (s+t)*d) > nodePrefix)
+                    s += t;
+                if (t <= 1) break;
+            }
+            int split = i + s*d + std::min(d, 0);
+
+            Node &node = nodes[i];
+            node.left = std::min(i, j) == split ? n-1 + split : split;
+            node.right = std::max(i, j) == split+1 ? n-1 + split+1 : split+1;
+            parents[node.left] = parents[node.right] = i;
+        }
+    });
+    auto emittedTime = Clock::now();
+
+    // bounds and surface area cost from the leaves up: the second thread
+    // to reach a node knows both children are done, and carries on
+    std::vector<float> cost(2*n - 1);
+    std::vector<int> count(2*n - 1, 1);
+    std::unique_ptr<std::atomic<int>[]> visits(new std::atomic<int>[std::max(n-1, 1)]);
+    auto climb = [&](bool restructuring) {
+        forChunks(pool, chunks, n-1, [&](int, int first, int last) {
+            for(int i=first; i < last; ++i)
+                visits[i].store(0, std::memory_order_relaxed);
+        });
+        forChunks(pool, chunks, n, [&](int, int first, int last) {
+            for(int i=first; i < last; ++i) {
+                int node = n-1 + i;
+                if (!restructuring)
+                    cost[node] = ObjectCost * halfArea(nodes[node].lo, nodes[node].hi);
+                while (node != 0) {
+                    node = parents[node];
+                    if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0)
+                        break;
+                    const Node &inner = nodes[node];
+                    if (!restructuring) {
+                        merge(node, inner.left, inner.right);
+                        cost[node] = NodeCost * halfArea(inner.lo, inner.hi)
+                            + cost[inner.left] + cost[inner.right];
+                        count[node] = count[inner.left] + count[inner.right];
+                    }
+                    else if (count[node] >= TreeletSize)
+                        restructure(node, parents, cost, count);
+                }
+            }
+        });
+    };
+    climb(false);
+    auto boundedTime = Clock::now();
+    float rootArea = std::max(halfArea(nodes[0].lo, nodes[0].hi), 1e-20f);
+    costBefore = cost[0] / rootArea;
+
+    // treelet passes, also from the leaves up, skipping small subtrees
+    // where there is little to gain
+    for(int pass=0; pass < treelets; ++pass)
+        climb(true);
+    auto treeletsTime = Clock::now();
+    costAfter = cost[0] / rootArea;
+
+    // treelets can deepen the tree past what the traversal stack holds,
+    // so rebuild without them if that happened
+    std::vector<std::pair<int,int> > stack(1, std::make_pair(0, 0));
+    while (!stack.empty()) {
+        std::pair<int,int> top = stack.back();
+        stack.pop_back();
+        depth = std::max(depth, top.second);
+        const Node &node = nodes[top.first];
+        if (node.left >= 0) {
+            stack.push_back(std::make_pair(node.left, top.second + 1));
+            stack.push_back(std::make_pair(node.right, top.second + 1));
+        }
+    }
+    if (depth >= StackSize) {
+        build(objects, 0, pool);
+        return;
+    }
+
+    std::chrono::duration<double> sorting = sortedTime - startTime,
+        emitting = emittedTime - sortedTime, bounding = boundedTime - emittedTime,
+        restructuring = treeletsTime - boundedTime;
+    sortTime = sorting.count();
+    emitTime = emitting.count();
+    boundsTime = bounding.count();
+    treeletTime = treelets > 0 ? restructuring.count() : 0;
+
+    // areas for tracking the cost as refits move the bounds
+    innerArea = leafArea = 0;
+    for(int i=0; i < 2*n - 1; ++i)
+        (i < n-1 ? innerArea : leafArea) += halfArea(nodes[i].lo, nodes[i].hi);
+    refits = 0;
+}
+
+// surface area cost, relative to the root
+float
+Bvh::cost() const
+{
+    if (nodes.empty()) return 0;
+    double rootArea = std::max(halfArea(nodes[0].lo, nodes[0].hi), 1e-20f);
+    return float((NodeCost * innerArea + ObjectCost * leafArea) / rootArea);
+}
+
+// new bounds for objects that moved, and for every node above them up to
+// the first whose bounds come out the same
+void
+Bvh::refit(const std::vector<Object*> &objects, const std::vector<int> &moved)
+{
+    if (nodes.empty()) return;
+    for(int obj : moved) {
+        int node = leafOf[obj];
+        Vec3 lo, hi;
+        objects[obj]->bounds(lo, hi);
+        leafArea -= halfArea(nodes[node].lo, nodes[node].hi);
+        for(int k=0; k < 3; ++k) {
+            nodes[node].lo[k] = lo[k];
+            nodes[node].hi[k] = hi[k];
+        }
+        leafArea += halfArea(nodes[node].lo, nodes[node].hi);
+
+        while (node != 0) {
+            node = parents[node];
+            Node before = nodes[node];
+            merge(node, before.left, before.right);
+            if (std::equal(before.lo, before.lo + 3, nodes[node].lo) &&
+                std::equal(before.hi, before.hi + 3, nodes[node].hi))
+                break;
+            innerArea += halfArea(nodes[node].lo, nodes[node].hi)
+                - halfArea(before.lo, before.hi);
+        }
+    }
+    ++refits;
+}
+
+// union of the bounds of nodes a and b into node n
+void
+Bvh::merge(int n, int a, int b)
+{
+    for(int k=0; k < 3; ++k) {
+        nodes[n].lo[k] = std::min(nodes[a].lo[k], nodes[b].lo[k]);
+        nodes[n].hi[k] = std::max(nodes[a].hi[k], nodes[b].hi[k]);
+    }
+}
+
+// rearrange the treelet rooted at internal node root for lower cost
+// grows the treelet by opening its largest internal leaf until it has
+// TreeletSize leaves, then finds the lowest-cost binary tree over those
+// leaves for every subset, smallest first, and rebuilds the treelet with
+// the same internal nodes if the best beats what is there
+void
+Bvh::restructure(int root, std::vector<int> &parents, std::vector<float> &cost,
+                 std::vector<int> &count)
+{
+    int leaves[TreeletSize], internals[TreeletSize - 1];
+    int size = 2, opened = 1;
+    leaves[0] = nodes[root].left;
+    leaves[1] = nodes[root].right;
+    internals[0] = root;
+    while (size < TreeletSize) {
+        int largest = -1;
+        float largestArea = -1;
+        for(int i=0; i < size; ++i) {
+            const Node &leaf = nodes[leaves[i]];
+            float area = halfArea(leaf.lo, leaf.hi);
+            if (leaf.left >= 0 && area > largestArea) {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if (largest < 0) break;
+        int node = leaves[largest];
+        internals[opened++] = node;
+        leaves[largest] = nodes[node].left;
+        leaves[size++] = nodes[node].right;
+    }
+    if (size < 3) return;
+
+    // bounds and best cost for each subset of the leaves
+    // every proper subset of s is a smaller number than s, so is done first
+    const int subsets = 1 << TreeletSize;
+    float lo[subsets][3], hi[subsets][3], best[subsets];
+    int partition[subsets];
+    int full = (1 << size) - 1;
+    for(int s=1; s <= full; ++s) {
+        int bit = 0;
+        while (!(s & (1 << bit)))
+            ++bit;
+        int rest = s & (s - 1);
+        const Node &leaf = nodes[leaves[bit]];
+        for(int k=0; k < 3; ++k) {
+            lo[s][k] = rest ? std::min(lo[rest][k], leaf.lo[k]) : leaf.lo[k];
+            hi[s][k] = rest ? std::max(hi[rest][k], leaf.hi[k]) : leaf.hi[k];
+        }
+        if (!rest) {
+            best[s] = cost[leaves[bit]];
+            continue;
+        }
+
+        // each split once, with the lowest leaf on the first side
+        float lowest = INFINITY;
+        int low = s & -s;
+        for(int p = (s - 1) & s; p; p = (p - 1) & s) {
+            if (!(p & low)) continue;
+            float c = best[p] + best[s ^ p];
+            if (c < lowest) {
+                lowest = c;
+                partition[s] = p;
+            }
+        }
+        best[s] = NodeCost * halfArea(lo[s], hi[s]) + lowest;
+    }
+    if (!(best[full] < cost[root] * 0.9999f))
+        return;
+
+    // hand out the internal nodes top down, then set bounds bottom up
+    int subset[TreeletSize - 1];
+    subset[0] = full;
+    int used = 1;
+    for(int q=0; q < used; ++q) {
+        int node = internals[q];
+        int sides[2] = {partition[subset[q]], subset[q] ^ partition[subset[q]]};
+        int child[2];
+        for(int c=0; c < 2; ++c) {
+            if (sides[c] & (sides[c] - 1)) {
+                child[c] = internals[used];
+                subset[used++] = sides[c];
+            }
+            else {
+                int bit = 0;
+                while (sides[c] != (1 << bit))
+                    ++bit;
+                child[c] = leaves[bit];
+            }
+            parents[child[c]] = node;
+        }
+        nodes[node].left = child[0];
+        nodes[node].right = child[1];
+    }
+    for(int q = used-1; q >= 0; --q) {
+        const Node &inner = nodes[internals[q]];
+        merge(internals[q], inner.left, inner.right);
+        cost[internals[q]] = best[subset[q]];
+        count[internals[q]] = count[inner.left] + count[inner.right];
+    }
+}
+
+// closest intersection of r with objects
+// tests both children of each node, and visits the nearer first
+const Intersection
+Bvh::trace(const std::vector<Object*> &objects, Ray r, uint64_t &tests) const
+{
+    Intersection closest;       // no object, t = infinity
+    if (nodes.empty()) return closest;
+
+    float4 E = r.E.simd(), invD = (Vec3(1, 1, 1) / r.D).simd();
+    struct Entry { int node; float t; } stack[StackSize];
+    int top = 0;
+    float t = entry(nodes[0].lo, nodes[0].hi, E, invD, r.near, r.far);
+    if (t < INFINITY) {
+        stack[top].node = 0;
+        stack[top++].t = t;
+    }
+
+    while (top > 0) {
+        Entry e = stack[--top];
+        if (e.t > r.far) continue;      // closer hit found since it was pushed
+        const Node &node = nodes[e.node];
+        if (node.left < 0) {
+            ++tests;
+            Intersection current = objects[node.right]->intersect(r);
+            if (current < closest) {
+                closest = current;
+                r.far = closest.t;      // anything farther can't be the closest
+            }
+            continue;
+        }
+
+        const Node &left = nodes[node.left], &right = nodes[node.right];
+        float tl = entry(left.lo, left.hi, E, invD, r.near, r.far);
+        float tr = entry(right.lo, right.hi, E, invD, r.near, r.far);
+        Entry near = {node.left, tl}, far = {node.right, tr};
+        if (tr < tl)
+            std::swap(near, far);
+        if (far.t < INFINITY) stack[top++] = far;
+        if (near.t < INFINITY) stack[top++] = near;
+    }
+    return closest;
+}
+
+// closest intersections of rays, interleaving group of them
+// each ray in flight is a small state machine that stops at every node:
+// it tests the node it stopped at, whose children, or object for a leaf,
+// were prefetched when it stopped there, then pops the next node and
+// prefetches what that will need before the next ray takes its turn
+void
+Bvh::traceGroup(const std::vector<Object*> &objects, const Ray *rays,
+                Intersection *hits, int count, int group, uint64_t &tests) const
+{
+    struct Entry { int node; float t; };
+    struct Flight {
+        int ray;                // index in rays, or -1 once there are none left
+        Ray r;
+        float4 E, invD;
+        int pending;            // node to test next, or -1 when done
+        int top;
+        Entry stack[StackSize];
+        Flight() : ray(-1), r(Vec3(), Vec3()), pending(-1), top(0) {}
+    };
+    std::vector<Flight> flights(std::max(1, std::min(group, count)));
+
+    // pop f's next node still closer than its closest hit, and prefetch
+    // what testing it will read
+    auto advance = [&](Flight &f) {
+        for(f.pending = -1; f.top > 0 && f.pending < 0; ) {
+            Entry e = f.stack[--f.top];
+            if (e.t > f.r.far) continue;
+            const Node &node = nodes[e.node];
+            if (node.left < 0)
+                prefetch(objects[node.right]);
+            else {
+                prefetch(&nodes[node.left]);
+                prefetch(&nodes[node.right]);
+            }
+            f.pending = e.node;
+        }
+    };
+
+    // give f the next ray, returning false if there are none left
+    int next = 0, active = 0;
+    auto start = [&](Flight &f) {
+        for(f.ray = -1; next < count && f.ray < 0; ) {
+            int k = next++;
+            hits[k] = Intersection();
+            if (nodes.empty()) continue;
+            f.r = rays[k];
+            f.E = f.r.E.simd();
+            f.invD = (Vec3(1, 1, 1) / f.r.D).simd();
+            float t = entry(nodes[0].lo, nodes[0].hi, f.E, f.invD, f.r.near, f.r.far);
+            if (t == INFINITY) continue;
+            f.ray = k;
+            f.top = 1;
+            f.stack[0].node = 0;
+            f.stack[0].t = t;
+            advance(f);
+        }
+        return f.ray >= 0;
+    };
+    for(auto &f : flights)
+        active += start(f);
+
+    while (active > 0) {
+        for(auto &f : flights) {
+            if (f.ray < 0) continue;
+
+            const Node &node = nodes[f.pending];
+            if (node.left < 0) {
+                ++tests;
+                Intersection current = objects[node.right]->intersect(f.r);
+                if (current < hits[f.ray]) {
+                    hits[f.ray] = current;
+                    f.r.far = current.t;
+                }
+            }
+            else {
+                const Node &left = nodes[node.left], &right = nodes[node.right];
+                float tl = entry(left.lo, left.hi, f.E, f.invD, f.r.near, f.r.far);
+                float tr = entry(right.lo, right.hi, f.E, f.invD, f.r.near, f.r.far);
+                Entry near = {node.left, tl}, far = {node.right, tr};
+                if (tr < tl)
+                    std::swap(near, far);
+                if (far.t < INFINITY) f.stack[f.top++] = far;
+                if (near.t < INFINITY) f.stack[f.top++] = near;
+            }
+
+            advance(f);
+            if (f.pending < 0 && !start(f))
+                --active;
+        }
+    }
+}
+
+// true if r hits any of objects between r.near and r.far
+bool
+Bvh::probe(const std::vector<Object*> &objects, const Ray &r, uint64_t &tests,
+           int *blocker) const
+{
+    if (nodes.empty()) return false;
+
+    float4 E = r.E.simd(), invD = (Vec3(1, 1, 1) / r.D).simd();
+    int stack[StackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node &node = nodes[stack[--top]];
+        if (entry(node.lo, node.hi, E, invD, r.near, r.far) == INFINITY)
+            continue;
+        if (node.left < 0) {
+            ++tests;
+            if (objects[node.right]->intersect(r).t < r.far) {
+                if (blocker) *blocker = node.right;
+                return true;
+            }
+            continue;
+        }
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+    }
+    return false;
+}
+
+// print build times, depth, and cost
+void
+Bvh::stats(std::ostream &out) const
+{
+    int objects = int(nodes.size() + 1) / 2;
+    double total = buildSeconds();
+    out << "BVH: " << objects << " objects, " << nodes.size() << " nodes, "
+        << bytes() / 1024 << " KB, depth " << depth << '\n'
+        << "  build " << 1000 * total << " ms (sort " << 1000 * sortTime
+        << ", emit " << 1000 * emitTime << ", bounds " << 1000 * boundsTime;
+    if (treeletTime > 0)
+        out << ", treelets " << 1000 * treeletTime;
+    out << "), " << (total > 0 ? objects / total / 1e6 : 0) << " M objects/s\n"
+        << "  surface area cost " << costBefore;
+    if (costAfter != costBefore)
+        out << ", " << costAfter << " after treelets";
+    out << '\n';
+}
@@ -0,0 +1,112 @@
+// bounding volume hierarchy over a list of objects
+#ifndef BVH_HPP
+#define BVH_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Intersection.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+
+// classes we only use by pointer or reference
+class Object;
+class Ray;
+class ThreadPool;
+
+// linear BVH, built by sorting objects along a Morton curve
+// the sorted Morton codes determine the whole tree: each internal node
+// splits its range at the highest bit where the codes differ, which every
+// node can find on its own, so radix sort, node emission, and bottom-up
+// bounds all run in parallel and the build takes milliseconds even for a
+// million objects; the tree comes out the same for any number of threads
+// optional treelet passes then rearrange each group of up to 5 subtrees
+// into the arrangement with the lowest surface area cost, recovering some
+// of the trace speed a Morton split gives up
+class Bvh {
+public: // public types
+    // internal nodes are nodes[0] to nodes[n-2], with the root at 0
+    // leaves, one per object, are nodes[n-1] to nodes[2n-2]
+    struct Node {
+        float lo[3], hi[3];     // bounds
+        int left, right;        // child node indices, or -1 and object for a leaf
+    };
+
+private: // private data
+    std::vector<Node> nodes;
+    int depth;                  // deepest leaf, with the root at 0
+
+    // for refits: parent of each node, and the leaf of each object
+    std::vector<int> parents;
+    std::vector<int> leafOf;
+
+    // build statistics
+    double sortTime, emitTime, boundsTime, treeletTime;
+    double costBefore, costAfter;   // surface area cost, relative to the root
+
+    // summed half areas of internal nodes and leaves, kept current by refit
+    double innerArea, leafArea;
+    int refits;                 // since the last build
+
+public: // constructors
+    Bvh() : depth(0), sortTime(0), emitTime(0), boundsTime(0), treeletTime(0),
+            costBefore(0), costAfter(0), innerArea(0), leafArea(0), refits(0) {}
+
+public: // manipulators
+    // rebuild for objects, using pool's threads if given
+    // treelets is the number of treelet restructuring passes, 0 for none
+    void build(const std::vector<Object*> &objects, int treelets, ThreadPool *pool);
+
+    // update bounds after the objects numbered in moved have moved,
+    // keeping the tree's shape, which gets worse the farther they go
+    void refit(const std::vector<Object*> &objects, const std::vector<int> &moved);
+
+public: // computational members
+    // closest intersection of r with objects, or none
+    // adds the number of objects tested to tests
+    const Intersection trace(const std::vector<Object*> &objects, Ray r,
+                             uint64_t &tests) const;
+
+    // closest intersections of count rays with objects, as trace would
+    // find them, with up to group rays in flight at once: each step of one
+    // ray prefetches what its next step reads, and the other rays take a
+    // step each while that loads, hiding the cache misses of large trees
+    void traceGroup(const std::vector<Object*> &objects, const Ray *rays,
+                    Intersection *hits, int count, int group, uint64_t &tests) const;
+
+    // true if r hits any of objects between r.near and r.far
+    // if blocker is given, it's set to the number of the object hit
+    bool probe(const std::vector<Object*> &objects, const Ray &r, uint64_t &tests,
+               int *blocker=0) const;
+
+    // bytes used by the tree
+    size_t bytes() const { return nodes.size() * sizeof(Node); }
+
+    // surface area cost relative to the root, now and as built
+    float cost() const;
+    float builtCost() const { return costAfter; }
+
+    // refits since the last build
+    int refitCount() const { return refits; }
+
+    // seconds the last build took
+    double buildSeconds() const { return sortTime + emitTime + boundsTime + treeletTime; }
+
+    // all nodes, for conversion to other layouts
+    const std::vector<Node> &tree() const { return nodes; }
+
+    // print times for each build stage, depth, and surface area cost
+    void stats(std::ostream &out) const;
+
+private: // internal helpers
+    // rearrange the treelet rooted at internal node root for lower cost
+    // parents, cost, and count of objects under each node are kept current
+    void restructure(int root, std::vector<int> &parents, std::vector<float> &cost,
+                     std::vector<int> &count);
+
+    // union of the bounds of nodes a and b into node n
+    void merge(int n, int a, int b);
+};
+
+#endif
@@ -0,0 +1,70 @@
+// implementation code for CacheCounters class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "CacheCounters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+
+// open a user-space cache read miss counter for the calling thread
+static int
+openCounter(uint64_t cache)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cache
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+CacheCounters::CacheCounters()
+{
+    l1fd = openCounter(PERF_COUNT_HW_CACHE_L1D);
+    llfd = openCounter(PERF_COUNT_HW_CACHE_LL);
+}
+
+CacheCounters::~CacheCounters()
+{
+    if (l1fd >= 0) close(l1fd);
+    if (llfd >= 0) close(llfd);
+}
+
+void
+CacheCounters::read(uint64_t &l1Misses, uint64_t &llMisses) const
+{
+    l1Misses = llMisses = 0;
+    if (l1fd >= 0 && ::read(l1fd, &l1Misses, sizeof(l1Misses)) != sizeof(l1Misses))
+        l1Misses = 0;
+    if (llfd >= 0 && ::read(llfd, &llMisses, sizeof(llMisses)) != sizeof(llMisses))
+        llMisses = 0;
+}
+
+#else
+// no counters on other systems
+
+CacheCounters::CacheCounters() : l1fd(-1), llfd(-1) {}
+CacheCounters::~CacheCounters() {}
+
+void
+CacheCounters::read(uint64_t &l1Misses, uint64_t &llMisses) const
+{
+    l1Misses = llMisses = 0;
+}
+#endif
+
+// counters for the calling thread
+CacheCounters &
+CacheCounters::local()
+{
+    static thread_local CacheCounters counters;
+    return counters;
+}
@@ -0,0 +1,30 @@
+// hardware cache miss counters for the calling thread
+#ifndef CACHECOUNTERS_HPP
+#define CACHECOUNTERS_HPP
+
+// system includes necessary for the interface
+#include <stdint.h>
+
+// L1 data and last-level cache read misses, from Linux perf events
+// L1D misses are the reads that go on to L2
+// counts are per thread, so each worker reads its own around each tile
+class CacheCounters {
+private: // private data
+    int l1fd, llfd;         // perf event file descriptors, -1 if unavailable
+
+public: // constructor & destructor
+    CacheCounters();
+    ~CacheCounters();
+
+public: // computational members
+    // true if the counters could be opened
+    bool available() const { return l1fd >= 0 && llfd >= 0; }
+
+    // current miss counts
+    void read(uint64_t &l1Misses, uint64_t &llMisses) const;
+
+    // counters for the calling thread, opened on first use
+    static CacheCounters &local();
+};
+
+#endif
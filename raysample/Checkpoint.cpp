@@ -0,0 +1,194 @@
+// implementation code for Checkpoint class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Checkpoint.hpp"
+
+// system includes
+#include <chrono>
+#include <map>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+// don't complain about MS-deprecated standard C functions
+#pragma warning( disable: 4996 )
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// file identification, changed if the layout changes
+static const char Magic[8] = { 'r','s','c','k','p','t','1','\n' };
+
+Checkpoint::Checkpoint(const std::string &_filename, uint64_t _hash,
+                       const TileList &_tiles, const Tile &_region)
+    : filename(_filename), hash(_hash), tiles(_tiles), region(_region),
+      image(_region.width(), _region.height()),
+      done(new std::atomic<bool>[_tiles.size()]),
+      quit(false), saves(0), saveTime(0)
+{
+    for(size_t t=0; t < tiles.size(); ++t)
+        done[t] = false;
+}
+
+Checkpoint::~Checkpoint()
+{
+    stop();
+}
+
+// load finished tiles
+int
+Checkpoint::resume()
+{
+    FILE *in = fopen(filename.c_str(), "rb");
+    if (!in) return -1;
+
+    char magic[sizeof(Magic)];
+    uint64_t fileHash;
+    int32_t r[4];
+    uint32_t count;
+    bool ok = fread(magic, sizeof(magic), 1, in) == 1 && memcmp(magic, Magic, sizeof(Magic)) == 0
+        && fread(&fileHash, sizeof(fileHash), 1, in) == 1 && fileHash == hash
+        && fread(r, sizeof(r), 1, in) == 1
+        && r[0] == region.x0 && r[1] == region.y0 && r[2] == region.x1 && r[3] == region.y1
+        && fread(&count, sizeof(count), 1, in) == 1;
+    if (!ok) {
+        fclose(in);
+        return -1;
+    }
+
+    // tiles by corner
+    std::map<std::pair<int,int>, int> index;
+    for(size_t t=0; t < tiles.size(); ++t)
+        index[std::make_pair(tiles[t].x0, tiles[t].y0)] = int(t);
+
+    int restored = 0;
+    for(uint32_t i=0; i < count; ++i) {
+        int32_t rect[4];
+        if (fread(rect, sizeof(rect), 1, in) != 1) break;
+        auto found = index.find(std::make_pair(rect[0], rect[1]));
+        if (found == index.end()) break;
+        const Tile &tile = tiles[found->second];
+        if (tile.x1 != rect[2] || tile.y1 != rect[3]) break;
+
+        bool complete = true;
+        for(int y=tile.y0; complete && y < tile.y1; ++y)
+            complete = fread(at(tile.x0, y), sizeof(float)*3, tile.width(), in)
+                == size_t(tile.width());
+        if (!complete) break;
+
+        finish(found->second);
+        ++restored;
+    }
+    fclose(in);
+    return restored;
+}
+
+// background saves
+void
+Checkpoint::start(float interval)
+{
+    saver = std::thread([this, interval]() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!wake.wait_for(guard, std::chrono::duration<float>(interval),
+                              [this]{ return quit; })) {
+            guard.unlock();
+            save();
+            guard.lock();
+        }
+    });
+}
+
+void
+Checkpoint::stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    if (saver.joinable())
+        saver.join();
+}
+
+// write done tiles to a temporary file, then rename it over the checkpoint
+void
+Checkpoint::save()
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // tiles done as of now; any finishing later go in the next save
+    std::vector<int> finished;
+    for(size_t t=0; t < tiles.size(); ++t)
+        if (isDone(int(t)))
+            finished.push_back(int(t));
+
+    std::string temp = filename + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if (!out) return;
+
+    int32_t r[4] = { region.x0, region.y0, region.x1, region.y1 };
+    uint32_t count = uint32_t(finished.size());
+    fwrite(Magic, sizeof(Magic), 1, out);
+    fwrite(&hash, sizeof(hash), 1, out);
+    fwrite(r, sizeof(r), 1, out);
+    fwrite(&count, sizeof(count), 1, out);
+    for(int t : finished) {
+        const Tile &tile = tiles[t];
+        int32_t rect[4] = { tile.x0, tile.y0, tile.x1, tile.y1 };
+        fwrite(rect, sizeof(rect), 1, out);
+        for(int y=tile.y0; y < tile.y1; ++y)
+            fwrite(at(tile.x0, y), sizeof(float)*3, tile.width(), out);
+    }
+
+    // the data must be on disk before the rename makes it the checkpoint
+    bool ok = fflush(out) == 0 && !ferror(out);
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(out)) == 0;
+#else
+    ok = ok && fsync(fileno(out)) == 0;
+#endif
+    fclose(out);
+#ifdef _WIN32
+    ::remove(filename.c_str());      // Windows rename won't replace a file
+#endif
+    if (!ok || rename(temp.c_str(), filename.c_str()) != 0) {
+        ::remove(temp.c_str());
+        return;
+    }
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<float> elapsed = endTime - startTime;
+    std::lock_guard<std::mutex> guard(lock);
+    ++saves;
+    saveTime += elapsed.count();
+}
+
+// remove checkpoint file
+void
+Checkpoint::remove()
+{
+    ::remove(filename.c_str());
+}
+
+// save stats
+void
+Checkpoint::stats(std::ostream &out) const
+{
+    out << saves << " Checkpoint" << (saves == 1 ? "" : "s");
+    if (saves)
+        out << ", " << 1000 * saveTime / saves << " ms each";
+    out << '\n';
+}
+
+// FNV-1a hash
+uint64_t
+Checkpoint::fnv(const void *data, size_t size, uint64_t h)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for(size_t i=0; i < size; ++i)
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    return h;
+}
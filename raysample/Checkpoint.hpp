@@ -0,0 +1,84 @@
+// periodic checkpoints of finished tiles, so a killed render can resume
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Image.hpp"
+#include "Tiles.hpp"
+
+// system includes necessary for the interface
+#include <string>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+#include <stdint.h>
+
+// finished tiles and their radiance, saved to a sidecar file
+// workers copy each finished tile into their own part of the image and
+// mark it done, without taking any lock; a background thread saves the done
+// tiles every few seconds to a temporary file and renames it over the
+// checkpoint, so the checkpoint on disk is always complete
+// the file starts with a hash of the scene and options, and is only
+// resumed if that matches
+class Checkpoint {
+private: // private data
+    std::string filename;           // checkpoint file
+    uint64_t hash;                  // of scene and options
+    const TileList &tiles;          // all tiles of the region
+    Tile region;                    // rendered part of the image
+    Image image;                    // radiance of finished tiles, region-sized
+    std::unique_ptr<std::atomic<bool>[]> done;  // per tile
+
+    // background saves
+    std::thread saver;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool quit;
+    int saves;                      // completed saves
+    float saveTime;                 // total seconds spent saving
+
+public: // constructor & destructor
+    // checkpoint for tiles of region, in filename
+    Checkpoint(const std::string &filename, uint64_t hash,
+               const TileList &tiles, const Tile &region);
+
+    // stops background saves, without a final save
+    ~Checkpoint();
+
+public: // computational members
+    // load finished tiles from the checkpoint file
+    // returns the number of tiles restored, or -1 if the file is missing,
+    // unreadable, or from a different scene or options
+    int resume();
+
+    // save every interval seconds in the background until stop
+    void start(float interval);
+    void stop();
+
+    // save the finished tiles now
+    void save();
+
+    // remove the checkpoint file, once the render is complete
+    void remove();
+
+    // tile t was loaded or saved as done
+    bool isDone(int t) const { return done[t].load(std::memory_order_acquire); }
+
+    // radiance for image pixel x,y, which must be in region
+    float *at(int x, int y) { return image.at(x - region.x0, y - region.y0); }
+
+    // all of tile t's pixels have been written with at()
+    void finish(int t) { done[t].store(true, std::memory_order_release); }
+
+    // print number of saves and time spent saving
+    void stats(std::ostream &out) const;
+
+    // 64-bit FNV-1a hash of size bytes of data, continuing from hash h
+    static uint64_t fnv(const void *data, size_t size,
+                        uint64_t h = 14695981039346656037ull);
+};
+
+#endif
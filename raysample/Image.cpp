@@ -0,0 +1,165 @@
+// implementation code for Image class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Image.hpp"
+
+// system includes
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+// don't complain about MS-deprecated standard C functions
+#pragma warning( disable: 4996 )
+#endif
+
+// true if floats are stored little-endian on this machine
+static bool
+littleEndian()
+{
+    uint32_t one = 1;
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+// swap bytes of n floats in place
+static void
+swapBytes(float *f, size_t n)
+{
+    for(size_t i=0; i < n; ++i) {
+        unsigned char *b = (unsigned char *)(f + i);
+        unsigned char t;
+        t = b[0]; b[0] = b[3]; b[3] = t;
+        t = b[1]; b[1] = b[2]; b[2] = t;
+    }
+}
+
+// read the next header integer, skipping comments
+// a crop comment fills in the crop position of image
+static bool
+readHeaderInt(FILE *in, int &value, Image &image)
+{
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        if (c == '#') {
+            char line[256];
+            if (!fgets(line, sizeof(line), in)) return false;
+            sscanf(line, " crop %d %d %d %d", &image.x0, &image.y0,
+                   &image.fullWidth, &image.fullHeight);
+        }
+        else if (!isspace(c)) {
+            ungetc(c, in);
+            return fscanf(in, "%d", &value) == 1;
+        }
+    }
+    return false;
+}
+
+// read a P6 ppm or PF pfm file
+bool
+Image::read(const char *filename)
+{
+    FILE *in = fopen(filename, "rb");
+    if (!in) return false;
+
+    x0 = y0 = 0;
+    fullWidth = fullHeight = -1;
+    char magic[3] = {0};
+    bool ok = fscanf(in, "%2s", magic) == 1
+        && readHeaderInt(in, width, *this) && readHeaderInt(in, height, *this)
+        && width > 0 && height > 0;
+    if (fullWidth < 0) {
+        fullWidth = width;
+        fullHeight = height;
+    }
+    if (ok && strcmp(magic, "P6") == 0) {
+        int maxval;
+        ok = readHeaderInt(in, maxval, *this) && maxval == 255;
+        fgetc(in);      // single whitespace after header
+
+        std::vector<unsigned char> bytes(size_t(width)*height*3);
+        ok = ok && fread(bytes.data(), 1, bytes.size(), in) == bytes.size();
+        pixels.resize(bytes.size());
+        for(size_t i=0; i < bytes.size(); ++i)
+            pixels[i] = bytes[i] / 255.f;
+    }
+    else if (ok && strcmp(magic, "PF") == 0) {
+        // scale is negative for little-endian data
+        float scale;
+        ok = fscanf(in, "%f", &scale) == 1 && scale != 0;
+        fgetc(in);
+
+        pixels.resize(size_t(width)*height*3);
+        for(int y=height-1; ok && y >= 0; --y)
+            ok = fread(at(0, y), sizeof(float), size_t(width)*3, in) == size_t(width)*3;
+        if ((scale < 0) != littleEndian())
+            swapBytes(pixels.data(), pixels.size());
+    }
+    else
+        ok = false;
+
+    fclose(in);
+    return ok;
+}
+
+// write the whole image
+void
+Image::write(FILE *out, Format format) const
+{
+    if (x0 || y0 || fullWidth != width || fullHeight != height)
+        writeHeader(out, format, width, height, x0, y0, fullWidth, fullHeight);
+    else
+        writeHeader(out, format, width, height);
+    writeRows(out, format, pixels.data(), width, height);
+}
+
+// format from a file name
+Image::Format
+Image::formatOf(const char *filename)
+{
+    size_t len = strlen(filename);
+    return len > 4 && strcmp(filename + len - 4, ".pfm") == 0 ? PFM : PPM;
+}
+
+// parse format name
+bool
+Image::parseFormat(const char *name, Format &format)
+{
+    if (strcmp(name, "ppm") == 0)       format = PPM;
+    else if (strcmp(name, "pfm") == 0)  format = PFM;
+    else return false;
+    return true;
+}
+
+// write file header
+void
+Image::writeHeader(FILE *out, Format format, int width, int height,
+                   int x0, int y0, int fullWidth, int fullHeight)
+{
+    fputs(format == PFM ? "PF\n" : "P6\n", out);
+    if (fullWidth > 0)
+        fprintf(out, "# crop %d %d %d %d\n", x0, y0, fullWidth, fullHeight);
+    if (format == PFM)
+        fprintf(out, "%d %d\n%s\n", width, height, littleEndian() ? "-1.0" : "1.0");
+    else
+        fprintf(out, "%d %d\n255\n", width, height);
+}
+
+// write rows of rgb floats
+void
+Image::writeRows(FILE *out, Format format, const float *rgb, int width, int rows)
+{
+    size_t rowSize = size_t(width)*3;
+    if (format == PFM) {
+        for(int y=rows-1; y >= 0; --y)
+            fwrite(rgb + y*rowSize, sizeof(float), rowSize, out);
+        return;
+    }
+
+    std::vector<unsigned char> bytes(rowSize * rows);
+    for(size_t i=0; i < bytes.size(); ++i)
+        bytes[i] = quantize(rgb[i]);
+    fwrite(bytes.data(), 1, bytes.size(), out);
+}
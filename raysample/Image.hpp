@@ -0,0 +1,64 @@
+// floating point rgb image, with ppm and pfm file I/O
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+// system includes necessary for the interface
+#include <vector>
+#include <stdio.h>
+
+// image in radiance, three floats per pixel, top row first
+// PPM files are clamped to [0,1] and quantised to 8 bits per channel
+// PFM (portable float map) files keep the full float radiance
+// an image rendered with a crop window records where it goes in the full
+// image in a "# crop x0 y0 fullWidth fullHeight" header comment
+class Image {
+public: // public data
+    enum Format { PPM, PFM };
+
+    int width, height;
+    std::vector<float> pixels;      // r, g, b for each pixel in row order
+
+    // position within the full image, for a crop
+    int x0, y0, fullWidth, fullHeight;
+
+public: // constructors
+    Image(int _width=0, int _height=0)
+        : width(_width), height(_height), pixels(size_t(_width)*_height*3),
+          x0(0), y0(0), fullWidth(_width), fullHeight(_height) {}
+
+public: // computational members
+    // rgb for pixel (x,y)
+    float *at(int x, int y) { return &pixels[(size_t(y)*width + x)*3]; }
+    const float *at(int x, int y) const { return &pixels[(size_t(y)*width + x)*3]; }
+
+    // read a P6 ppm or PF pfm file, returning false on failure
+    bool read(const char *filename);
+
+    // write the whole image
+    void write(FILE *out, Format format) const;
+
+public: // file format helpers, for writing an image a piece at a time
+    // 8-bit value for one channel, as Vec3::r() would give
+    static unsigned char quantize(float v) {
+        return v<0 ? 0 : (v>1 ? 255 : (unsigned char)(255*v + .5));
+    }
+
+    // format from a file name: pfm for *.pfm, otherwise ppm
+    static Format formatOf(const char *filename);
+
+    // parse "ppm" or "pfm", returning false if unknown
+    static bool parseFormat(const char *name, Format &format);
+
+    // write the file header for a width x height image
+    // if it is a crop, at x0,y0 of a fullWidth x fullHeight image, say so
+    static void writeHeader(FILE *out, Format format, int width, int height,
+                            int x0=0, int y0=0, int fullWidth=0, int fullHeight=0);
+
+    // write rows of rgb floats, in file order
+    // PFM is stored bottom row first, so for PFM the rows are written
+    // last to first, and the caller writes bands bottom band first
+    static void writeRows(FILE *out, Format format, const float *rgb,
+                          int width, int rows);
+};
+
+#endif
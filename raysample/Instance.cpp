@@ -0,0 +1,112 @@
+// implementation code for Geometry and Instance classes
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Instance.hpp"
+
+// other classes used directly in the implementation
+#include "ObjectList.hpp"
+#include "Ray.hpp"
+
+// delete the parts
+Geometry::~Geometry()
+{
+    for(auto obj : parts)
+        delete obj;
+}
+
+// add part, numbering it by its position
+void
+Geometry::addPart(Object *obj)
+{
+    obj->id = int(parts.size());
+    parts.push_back(obj);
+}
+
+// build shared BVH and overall bounds
+void
+Geometry::close()
+{
+    bvh.build(parts, 0, 0);
+    for(size_t i=0; i < parts.size(); ++i) {
+        Vec3 partLo, partHi;
+        parts[i]->bounds(partLo, partHi);
+        lo = i ? min(lo, partLo) : partLo;
+        hi = i ? max(hi, partHi) : partHi;
+    }
+}
+
+// instance shading with each part's surface
+Instance::Instance(std::shared_ptr<const Geometry> _geometry, const Transform &_toWorld)
+    : geometry(_geometry), toWorld(_toWorld), toObject(_toWorld.inverse()),
+      material(false)
+{}
+
+// instance shading every part with one surface
+Instance::Instance(std::shared_ptr<const Geometry> _geometry, const Transform &_toWorld,
+                   const Surface &_surface)
+    : Object(_surface), geometry(_geometry), toWorld(_toWorld),
+      toObject(_toWorld.inverse()), material(true)
+{}
+
+// ray in geometry coordinates
+// direction is transformed but not normalized, so t is the same in both
+const Ray
+Instance::local(const Ray &ray) const
+{
+    return Ray(toObject.point(ray.E), toObject.vector(ray.D), ray.near, ray.far);
+}
+
+// closest hit on any part, remembering which part for the hit record
+const Intersection
+Instance::intersect(const Ray &ray) const
+{
+    uint64_t tests = 0;
+    Intersection closest = geometry->bvh.trace(geometry->parts, local(ray), tests);
+    ObjectList::countTests(tests);
+    if (!closest.object()) return closest;
+
+    Intersection isect(this, closest.t, closest.u, closest.v);
+    isect.part = closest.object()->id;
+    return isect;
+}
+
+// part's hit record, moved back to world coordinates
+void
+Instance::hitRecord(const Ray &ray, const Intersection &isect, HitRecord &hit) const
+{
+    const Object *part = geometry->parts[isect.part];
+    part->hitRecord(local(ray), Intersection(part, isect.t, isect.u, isect.v), hit);
+    hit.P = fma(isect.t, ray.D, ray.E);
+    hit.N = normalize(toObject.normal(hit.N));
+    hit.prim = id;
+}
+
+// transformed corners of the geometry's bounds
+void
+Instance::bounds(Vec3 &lo, Vec3 &hi) const
+{
+    for(int c=0; c < 8; ++c) {
+        Vec3 corner((c & 1 ? geometry->hi : geometry->lo)[0],
+                    (c & 2 ? geometry->hi : geometry->lo)[1],
+                    (c & 4 ? geometry->hi : geometry->lo)[2]);
+        Vec3 P = toWorld.point(corner);
+        lo = c ? min(lo, P) : P;
+        hi = c ? max(hi, P) : P;
+    }
+}
+
+// new placement after the current one
+void
+Instance::move(const Transform &t)
+{
+    toWorld = t * toWorld;
+    toObject = toWorld.inverse();
+}
+
+// part's own object, unless this instance has a material
+const Object *
+Instance::shader(int part) const
+{
+    return material ? this : geometry->parts[part];
+}
@@ -0,0 +1,66 @@
+// instances: shared geometry placed by a transform
+#ifndef INSTANCE_HPP
+#define INSTANCE_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Object.hpp"
+#include "Transform.hpp"
+#include "Bvh.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <memory>
+
+// classes we only use by pointer or reference
+class Ray;
+
+// objects from one "define" block in the scene, in their own coordinates,
+// with a BVH over them that every instance shares
+class Geometry {
+public: // public data
+    std::vector<Object*> parts;     // owned, numbered by position
+    Bvh bvh;
+    Vec3 lo, hi;                    // bounds of all parts
+
+public: // constructor & destructor
+    Geometry() : lo(0,0,0), hi(0,0,0) {}
+    ~Geometry();
+
+public: // manipulators
+    // add an object allocated with new
+    void addPart(Object *obj);
+
+    // build the BVH and bounds once all parts are added
+    void close();
+};
+
+// one placement of a geometry: rays are moved into the geometry's
+// coordinates and traced through its shared BVH, so each copy costs a
+// transform and a pointer rather than its own objects
+// hits shade with each part's own surface, or with one surface for all
+// parts if the instance was given a material
+class Instance : public Object {
+private: // private data
+    std::shared_ptr<const Geometry> geometry;
+    Transform toWorld, toObject;
+    bool material;                  // shade with this object's surface
+
+public: // constructors
+    Instance(std::shared_ptr<const Geometry> _geometry, const Transform &_toWorld);
+    Instance(std::shared_ptr<const Geometry> _geometry, const Transform &_toWorld,
+             const Surface &_surface);
+
+public: // object functions
+    const Intersection intersect(const Ray &ray) const override;
+    void hitRecord(const Ray &ray, const Intersection &isect,
+                   HitRecord &hit) const override;
+    void bounds(Vec3 &lo, Vec3 &hi) const override;
+    void move(const Transform &t) override;
+    const Object *shader(int part) const override;
+
+private: // internal helpers
+    // ray in the geometry's coordinates, with the same t along it
+    const Ray local(const Ray &ray) const;
+};
+
+#endif
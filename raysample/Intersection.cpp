@@ -7,19 +7,27 @@
 // other classes used directly in the implementation
 #include "Object.hpp"
 #include "World.hpp"
+#include "ShadeCache.hpp"
 
 
 // new intersection with object and intersection location
-Intersection::Intersection(const Object *_obj, float _t) {
+Intersection::Intersection(const Object *_obj, float _t, float _u, float _v) {
     t = _t;
+    u = _u;
+    v = _v;
+    part = -1;
     obj = _obj;
 }
 
 // return color for one intersection
 const Vec3 
-Intersection::color(const World &w, const Ray &r) const {
+Intersection::color(const World &w, const Ray &r, const HitRecord &hit, ShadePath *path) const {
+    // hits too deep to record aren't shaded onto the path
+    if (path && !path->add(obj ? obj->id : -1, part, r, hit))
+        path = 0;
+
     if (obj)
-        return obj->color(w, r, t);
+        return obj->shader(part)->color(w, r, hit, path);
     else
         // background color
         return w.background;
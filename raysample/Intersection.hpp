@@ -9,24 +9,40 @@
 class World;
 class Object;
 class Ray;
+class ShadePath;
+
+// geometric data for the closest hit, filled once the closest object is
+// known so shading doesn't have to recompute it
+struct HitRecord {
+    Vec3 P;                 // hit position
+    Vec3 N;                 // geometric normal
+    int prim;               // primitive ID, object's index in the ObjectList
+    float u, v;             // surface coordinates, polygon plane basis for polygons
+};
 
 // intersection results: contains object hit and t of first intersection point
 class Intersection {
 public: // public data
     float t;                // where along ray?
+    float u, v;             // surface coordinates computed by the intersection test
+    int part;               // object hit within an instance, or -1
 
 private: // private data
     const Object *obj;    // what did we hit?
 
 public: // constructors
     // default construct with no object, intersection at infinity
-    Intersection(const Object *_obj=0, float _t=INFINITY);
+    Intersection(const Object *_obj=0, float _t=INFINITY, float _u=0, float _v=0);
 
     // we also also allow default copy constructor and assignment
 
 public: // computational members
-    // get color for this intersection
-    const Vec3 color(const World&, const Ray&) const;
+    // object hit, or null for none
+    const Object *object() const { return obj; }
+
+    // get color for this intersection, given its hit record
+    // if path is given, the hit is recorded on it, up to its bounce limit
+    const Vec3 color(const World&, const Ray&, const HitRecord&, ShadePath *path=0) const;
 };
 
 // compare two intersections by comparing t distance
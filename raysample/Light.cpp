@@ -0,0 +1,111 @@
+// implementation code for Light class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Light.hpp"
+
+// other classes used directly in the implementation
+#include "ObjectList.hpp"
+#include "Random.hpp"
+
+// system includes
+#include <atomic>
+#include <algorithm>
+
+static std::atomic<long long> AreaCount(0), RefineCount(0), AreaRays(0);
+
+// full area light sample count
+int Light::shadowSamples = 16;
+
+// is segment from P to Q blocked?
+static bool
+blocked(const ObjectList &objects, const Vec3 &P, const Vec3 &Q)
+{
+    Vec3 L = Q - P;
+    float LLen = length(L);
+    return objects.probe(Ray(P, L / LLen, 1e-4f, LLen));
+}
+
+// fraction of the light visible from P
+float
+Light::visibility(const ObjectList &objects, const Vec3 &P) const
+{
+    if (type == POINT)
+        return blocked(objects, P, pos) ? 0.f : 1.f;
+
+    // n x n jittered strata, probing the four corner strata first
+    Random &rng = Random::local();
+    int n = std::max(2, int(sqrtf(float(shadowSamples))));
+    auto visible = [&](int s, int t) {
+        Vec3 Q = point((s + rng.uniform())/n, (t + rng.uniform())/n, P);
+        return blocked(objects, P, Q) ? 0 : 1;
+    };
+
+    int count = visible(0,0) + visible(n-1,0) + visible(0,n-1) + visible(n-1,n-1);
+    ++AreaCount;
+    AreaRays += shadowProbes;
+
+    // fully lit or fully shadowed, unless something small slipped between
+    if (count == 0 || count == shadowProbes || n == 2)
+        return float(count) / shadowProbes;
+
+    // penumbra: trace the rest
+    ++RefineCount;
+    for(int t=0; t < n; ++t) {
+        for(int s=0; s < n; ++s) {
+            if ((s == 0 || s == n-1) && (t == 0 || t == n-1))
+                continue;
+            count += visible(s, t);
+        }
+    }
+    AreaRays += n*n - shadowProbes;
+    return float(count) / float(n*n);
+}
+
+// point on an area light for stratum (s,t), seen from P
+const Vec3
+Light::point(float s, float t, const Vec3 &P) const
+{
+    switch (type) {
+    case RECT:
+        return pos + (s - 0.5f)*edge1 + (t - 0.5f)*edge2;
+
+    case SPHERE: {
+        // disk of the sphere's silhouette as seen from P
+        Vec3 W = normalize(P - pos);
+        Vec3 U = normalize(cross(fabsf(W[0]) > 0.5f ? Vec3(0,1,0) : Vec3(1,0,0), W));
+        Vec3 V = cross(W, U);
+
+        // concentric square to disk map, so the corner strata land on
+        // four well separated points around the edge
+        float a = 2*s - 1, b = 2*t - 1, r, phi;
+        if (a == 0 && b == 0)
+            r = phi = 0;
+        else if (fabsf(a) > fabsf(b)) {
+            r = a;
+            phi = float(M_PI/4) * (b/a);
+        }
+        else {
+            r = b;
+            phi = float(M_PI/2) - float(M_PI/4) * (a/b);
+        }
+        return pos + (radius * r) * (cosf(phi)*U + sinf(phi)*V);
+    }
+
+    default:
+        return pos;
+    }
+}
+
+// print area light shadow ray statistics
+void
+Light::stats(std::ostream &out)
+{
+    if (AreaCount == 0) return;
+
+    int n = std::max(2, int(sqrtf(float(shadowSamples))));
+    out << AreaCount << " Area light shadow" << (AreaCount == 1 ? "" : "s") << "; "
+        << 100.f * RefineCount / AreaCount << "% in penumbra; "
+        << AreaRays << " Shadow rays vs " << AreaCount * n*n << " at fixed "
+        << n*n << " per light\n";
+}
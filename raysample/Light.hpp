@@ -0,0 +1,43 @@
+// point and area lights
+#ifndef LIGHT_HPP
+#define LIGHT_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Vec3.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <ostream>
+
+// classes we only use by pointer or reference
+class ObjectList;
+
+struct Light {
+    enum Type { POINT, RECT, SPHERE };
+
+    Type type;                  // light shape
+    Vec3 col;                   // light color
+    Vec3 pos;                   // light position, center for area lights
+    Vec3 edge1, edge2;          // RECT: edge vectors, rectangle spans pos +/- edge/2
+    float radius;               // SPHERE: radius
+
+    // area light shadow sampling: probe this many rays first, and only trace
+    // the full set if some but not all of the probes are blocked
+    static int shadowSamples;   // full set, rounded down to n x n
+    static const int shadowProbes = 4;
+
+    Light() : type(POINT), col(1,1,1), pos(0,0,0), radius(0) {}
+    Light(Vec3 _col, Vec3 _pos) : type(POINT), col(_col), pos(_pos), radius(0) {}
+
+    // fraction of the light visible from P, from 0 (in shadow) to 1
+    float visibility(const ObjectList &objects, const Vec3 &P) const;
+
+    // point on an area light for stratum (s,t) in [0,1)^2, as seen from P
+    const Vec3 point(float s, float t, const Vec3 &P) const;
+
+    // print area light shadow ray statistics
+    static void stats(std::ostream &out);
+};
+typedef std::vector<Light> LightList;
+
+#endif
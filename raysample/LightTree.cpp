@@ -0,0 +1,116 @@
+// implementation code for LightTree class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "LightTree.hpp"
+
+// other classes used directly in the implementation
+#include "World.hpp"
+
+// system includes
+#include <algorithm>
+
+// rebuild tree for a list of lights
+void
+LightTree::build(const std::vector<Light> &lights)
+{
+    nodes.clear();
+    if (lights.empty()) return;
+
+    nodes.reserve(2*lights.size() - 1);
+    std::vector<int> order(lights.size());
+    for(size_t i=0; i < order.size(); ++i)
+        order[i] = int(i);
+    buildNode(lights, order, 0, int(order.size()));
+}
+
+// build node for lights order[first] to order[last-1], returning node index
+int
+LightTree::buildNode(const std::vector<Light> &lights, std::vector<int> &order,
+                     int first, int last)
+{
+    int index = int(nodes.size());
+    nodes.push_back(Node());
+
+    Node node;
+    node.lo = node.hi = lights[order[first]].pos;
+    node.intensity = 0;
+    for(int i=first; i < last; ++i) {
+        const Light &li = lights[order[i]];
+        node.lo = min(node.lo, li.pos);
+        node.hi = max(node.hi, li.pos);
+        node.intensity += (li.col[0] + li.col[1] + li.col[2]) / 3;
+    }
+
+    if (last - first == 1) {
+        node.left = node.right = -1;
+        node.light = order[first];
+    }
+    else {
+        // split at the median along the longest axis
+        Vec3 extent = node.hi - node.lo;
+        int axis = extent[0] > extent[1]
+            ? (extent[0] > extent[2] ? 0 : 2)
+            : (extent[1] > extent[2] ? 1 : 2);
+        int mid = (first + last) / 2;
+        std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + last,
+            [&](int a, int b) { return lights[a].pos[axis] < lights[b].pos[axis]; });
+
+        node.light = -1;
+        node.left = buildNode(lights, order, first, mid);
+        node.right = buildNode(lights, order, mid, last);
+    }
+
+    nodes[index] = node;
+    return index;
+}
+
+// estimated contribution of a cluster of lights to point P with normal N
+// intensity over squared distance to the cluster bounds, but no closer than
+// the cluster size, times a bound on the cosine to the surface normal
+float
+LightTree::importance(const Node &node, const Vec3 &P, const Vec3 &N) const
+{
+    // farthest extent of the bounds along N
+    float above = 0;
+    for(int k=0; k < 3; ++k)
+        above += N[k] * ((N[k] > 0 ? node.hi[k] : node.lo[k]) - P[k]);
+    if (above <= 0) return 0;
+
+    Vec3 d = min(max(P, node.lo), node.hi) - P;
+    Vec3 extent = node.hi - node.lo;
+    float d2 = std::max(std::max(dot(d,d), 0.25f*dot(extent,extent)), 1e-6f);
+    float cosine = std::min(1.f, above * rsqrt(d2));
+    return node.intensity * cosine / d2;
+}
+
+// walk from the root, choosing children in proportion to importance
+int
+LightTree::sample(const Vec3 &P, const Vec3 &N, float u, float &pdf) const
+{
+    pdf = 1;
+    if (nodes.empty()) return -1;
+
+    int index = 0;
+    while (nodes[index].left >= 0) {
+        const Node &node = nodes[index];
+        float il = importance(nodes[node.left], P, N);
+        float ir = importance(nodes[node.right], P, N);
+        if (il + ir <= 0) return -1;
+
+        // reuse u for the next level by rescaling the chosen interval to [0,1)
+        float pl = il / (il + ir);
+        if (u < pl) {
+            index = node.left;
+            pdf *= pl;
+            u = u / pl;
+        }
+        else {
+            index = node.right;
+            pdf *= 1 - pl;
+            u = (u - pl) / (1 - pl);
+        }
+        u = std::min(u, 0.99999994f);
+    }
+    return nodes[index].light;
+}
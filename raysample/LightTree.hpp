@@ -0,0 +1,44 @@
+// hierarchy of lights for choosing a few lights per shading point
+#ifndef LIGHTTREE_HPP
+#define LIGHTTREE_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Vec3.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+
+// classes we only use by pointer or reference
+struct Light;
+
+// binary tree of lights, clustered by position
+// each node keeps the bounds and total intensity of the lights below it,
+// so sampling can walk from the root toward the lights most likely to
+// matter for a point, with cost logarithmic in the number of lights
+class LightTree {
+private: // private data
+    struct Node {
+        Vec3 lo, hi;            // bounds of light positions
+        float intensity;        // total intensity of lights in this subtree
+        int left, right;        // child node indices, -1 for a leaf
+        int light;              // light index for a leaf
+    };
+    std::vector<Node> nodes;    // root is nodes[0]
+
+public: // manipulators
+    // rebuild the tree for a list of lights
+    void build(const std::vector<Light> &lights);
+
+public: // computational members
+    // pick a light for point P with normal N, given uniform random u in [0,1)
+    // returns the light index and its selection probability in pdf,
+    // or -1 if no light can contribute
+    int sample(const Vec3 &P, const Vec3 &N, float u, float &pdf) const;
+
+private: // internal helpers
+    int buildNode(const std::vector<Light> &lights, std::vector<int> &order,
+                  int first, int last);
+    float importance(const Node &node, const Vec3 &P, const Vec3 &N) const;
+};
+
+#endif
@@ -4,22 +4,103 @@
 // everything it needs for internal self-consistency
 #include "Object.hpp"
 #include "World.hpp"
+#include "Random.hpp"
+#include "ShadeCache.hpp"
 
 // default constructor just uses default color
-Object::Object() {}
+Object::Object() : id(-1) {}
 
 // construct object given surface appearance
-Object::Object(const Surface &_surface) {
+Object::Object(const Surface &_surface) : id(-1) {
     surface = _surface; 
 }
 
 // virtual destructor since this class has virtual members and derived children
 Object::~Object() {}
 
+// decide whether to trace a secondary ray with coefficient k
+// without roulette, trace if its influence is above the ray's cutoff
+// with roulette, always trace influence above the roulette threshold, 
+// and trace lower influence with probability influence/threshold,
+// scaling k and the child ray influence up to keep the result unbiased
+static bool
+traceSecondary(const Ray &ray, float &k, float &influence)
+{
+    influence = ray.influence * k;
+    if (ray.bounces <= 0 || k <= 0)
+        return false;
+
+    if (World::roulette <= 0 || influence >= World::roulette)
+        return influence > ray.cutoff;
+
+    float p = influence / World::roulette;
+    if (Random::local().uniform() >= p)
+        return false;
+    k /= p;
+    influence = World::roulette;
+    return true;
+}
+
+// diffuse and specular color from one light at P with normal N and view V
+const Vec3 Object::lightColor(const World &world, const Light &li,
+                              const Vec3 &P, const Vec3 &N, const Vec3 &V,
+                              float *visibility, bool recorded) const
+{
+    Vec3 col(0,0,0);
+
+    Vec3 L = li.pos - P;   // light vector
+    float LLen = length(L);
+    L = L / LLen;
+
+    float N_dot_L = dot(N,L);
+
+    // check for negative dot product first to avoid shadow cast
+    if (N_dot_L > 0) {
+
+        // cast ray(s) to see how much is in shadow
+        float visible = 1;
+        if (recorded)
+            visible = *visibility;
+        else if (World::effects & World::SHADOW) {
+            if (li.type == Light::POINT)
+                visible = world.objects.probe(Ray(P, L, 1e-4f, LLen)) ? 0.f : 1.f;
+            else
+                visible = li.visibility(world.objects, P);
+            if (visibility)
+                *visibility = visible;
+        }
+
+        if (visible > 0) {
+            Vec3 lcol = visible * li.col;
+
+            if (World::effects & World::DIFFUSE)
+                col = col + lcol * surface.diffuse * N_dot_L;
+
+            if ((World::effects & World::SPECULAR) && 
+                surface.specular[0]+surface.specular[1]+surface.specular[2] > 0.f) {
+
+                // normalized L and H
+                Vec3 H = normalize(V+L);
+
+                float N_dot_H = dot(N,H);
+                if (N_dot_H > 0)
+                    col = col + lcol * surface.specular * pow(N_dot_H, surface.e);
+            }
+        }
+    }
+
+    return col;
+}
+
 // shared surface color computation for all object types
 // Color of this object
-const Vec3 Object::color(const World &world, const Ray &ray, float t) const
+const Vec3 Object::color(const World &world, const Ray &ray, const HitRecord &hit,
+                         ShadePath *path, float *shadows, bool reused) const
 {
+    // this hit on the path, if any, and whether to shade from it
+    int at = path ? path->current() : -1;
+    bool replay = path && path->replaying();
+
     // base color
     Vec3 col(0,0,0);
 
@@ -30,58 +111,78 @@ const Vec3 Object::color(const World &world, const Ray &ray, float t) const
     Vec3 V = -normalize(ray.D);
 
     // position and normal at intersection
-    Vec3 P = ray.E + t * ray.D;
-    Vec3 N = normal(P);
+    const Vec3 &P = hit.P;
+    const Vec3 &N = hit.N;
 
     // diffuse and specular
-    for (auto li : world.lights) {
-
-        Vec3 L = li.pos - P;   // light vector
-        float LLen = length(L);
-        L = L / LLen;
-
-        float N_dot_L = dot(N,L);
-
-        // check for negative dot product first to avoid shadow cast
-        if (N_dot_L > 0) {
-
-            // cast ray to see if it's in shadow
-            if (! (World::effects & World::SHADOW) || 
-                ! world.objects.probe(Ray(P, L, 1e-4f, LLen))) {
-
-                if (World::effects & World::DIFFUSE)
-                    col = col + li.col * surface.diffuse * N_dot_L;
+    if (World::lightSamples > 0 && world.lights.size() > size_t(World::lightSamples)) {
+        // fixed budget of lights chosen from the light tree,
+        // each weighted by 1/probability to stay unbiased
+        for (int s=0; s < World::lightSamples; ++s) {
+            float pdf;
+            int li = world.lightTree.sample(P, N, Random::local().uniform(), pdf);
+            if (li >= 0)
+                col = col + lightColor(world, world.lights[li], P, N, V) 
+                    / (pdf * World::lightSamples);
+        }
+    }
+    else {
+        uint64_t before = ObjectList::threadShadows();
+        for (size_t l=0; l < world.lights.size(); ++l) {
+            float *visibility = path ? &path->visibility[path->hits[at].visibility + l]
+                                     : shadows ? shadows + l : 0;
+            col = col + lightColor(world, world.lights[l], P, N, V, visibility,
+                                   replay || reused);
+        }
+        if (shadows && !reused)
+            shadows[world.lights.size()] = float(ObjectList::threadShadows() - before);
+    }
 
-                if ((World::effects & World::SPECULAR) && 
-                    surface.specular[0]+surface.specular[1]+surface.specular[2] > 0.f) {
+    // reflected and refracted colors on a path being shaded again
+    if (replay) {
+        int reflect = path->hits[at].reflect, refract = path->hits[at].refract;
+        if (reflect >= 0)
+            col = col + surface.kr * path->color(world, reflect);
+        if (refract >= 0)
+            col = col + surface.kt * path->color(world, refract);
+        return col;
+    }
 
-                    // normalized L and H
-                    Vec3 H = normalize(V+L);
+    return secondary(world, ray, hit, col, path);
+}
 
-                    float N_dot_H = dot(N,H);
-                    if (N_dot_H > 0)
-                        col = col + li.col * surface.specular * pow(N_dot_H, surface.e);
-                }
-            }
-        }
-    }
+// reflected and refracted colors added to direct
+const Vec3 Object::secondary(const World &world, const Ray &ray, const HitRecord &hit,
+                             const Vec3 &direct, ShadePath *path) const
+{
+    int at = path ? path->current() : -1;
+    Vec3 col = direct;
+    Vec3 V = -normalize(ray.D);
+    const Vec3 &P = hit.P;
+    const Vec3 &N = hit.N;
 
     // reflected rays
+    float kr = surface.kr, rinfluence;
     if ((World::effects & World::REFLECT) &&
-        ray.influence * surface.kr > world.cutoff && ray.bounces > 0) {
+        traceSecondary(ray, kr, rinfluence)) {
 
         // reflect ray off surface
         Vec3 rv = ray.D - 2*dot(N, ray.D)*N;
 
         // new ray with one less bounce and influence reduced by kr
-        Ray rr(P, rv, 1e-4f, INFINITY, ray.bounces-1, ray.influence*surface.kr);
-        Vec3 rc = world.objects.trace(rr).color(world,rr); // trace ray
-        col = col + surface.kr * rc;
+        Ray rr(P, rv, 1e-4f, INFINITY, ray.bounces-1, rinfluence, ray.cutoff);
+        HitRecord rhit;
+        int child = path ? int(path->hits.size()) : -1;
+        Vec3 rc = world.objects.trace(rr, &rhit).color(world, rr, rhit, path); // trace ray
+        col = col + kr * rc;
+        if (path && int(path->hits.size()) > child)
+            path->hits[at].reflect = child;
     }
 
     // refracted rays
+    float kt = surface.kt, tinfluence;
     if ((World::effects & World::REFRACT) &&
-            ray.influence * surface.kt > world.cutoff && ray.bounces > 0) {
+            traceSecondary(ray, kt, tinfluence)) {
 
         // compute refracted ray
         float ci = dot(N,V);                // cosine of incident ray angle
@@ -96,9 +197,13 @@ const Vec3 Object::color(const World &world, const Ray &ray, float t) const
                 td = N*(ci*tir + sqrtf(ct2)) - V*tir;
 
             // new ray with one fewer bounce and influence reduced by kt
-            Ray tr(P, td, 1e-4f, INFINITY, ray.bounces-1, ray.influence*surface.kt);
-            Vec3 tc = world.objects.trace(tr).color(world,tr); // trace ray
-            col = col + surface.kt * tc;
+            Ray tr(P, td, 1e-4f, INFINITY, ray.bounces-1, tinfluence, ray.cutoff);
+            HitRecord thit;
+            int child = path ? int(path->hits.size()) : -1;
+            Vec3 tc = world.objects.trace(tr, &thit).color(world, tr, thit, path); // trace ray
+            col = col + kt * tc;
+            if (path && int(path->hits.size()) > child)
+                path->hits[at].refract = child;
         }
     }
 
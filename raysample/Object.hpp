@@ -9,6 +9,9 @@
 // classes we only use by pointer or reference
 class World;
 class Ray;
+struct Light;
+struct Transform;
+class ShadePath;
 
 // collected surface appearance parameters
 struct Surface {
@@ -25,6 +28,9 @@ class Object {
 protected: // data visible to children
     Surface surface;        // this object's appearance parameters
 
+public: // public data
+    int id;                 // primitive ID, assigned by ObjectList
+
 public: // constructor & destructor
     Object();
     Object(const Surface &_surface);
@@ -32,14 +38,47 @@ public: // constructor & destructor
 
 
 public: // computational members
+    // appearance parameters
+    const Surface &appearance() const { return surface; }
+
     // return t for closest intersection with ray
     virtual const Intersection intersect(const Ray &ray) const = 0;
 
-    // normal for at point P
-    virtual const Vec3 normal(const Vec3 P) const = 0;
+    // fill hit record for the closest intersection
+    virtual void hitRecord(const Ray &ray, const Intersection &isect, 
+                           HitRecord &hit) const = 0;
+
+    // axis-aligned bounding box, for acceleration structures
+    virtual void bounds(Vec3 &lo, Vec3 &hi) const = 0;
+
+    // move by transform t, for animation
+    virtual void move(const Transform &t) = 0;
+
+    // object whose surface shades a hit on part of this one
+    virtual const Object *shader(int /*part*/) const { return this; }
 
 	// compute color at ray intersection
-	const Vec3 color(const World &w, const Ray &r, float t) const;
+	// with a path, recording this hit's shadows and secondary rays on it,
+	// or if it's replaying, shading from them instead of tracing rays
+	// without one, if shadows is given, each light's visibility from this
+	// hit is stored there, then the number of shadow rays they took, or if
+	// reused, the visibilities are read from it instead
+	const Vec3 color(const World &w, const Ray &r, const HitRecord &hit,
+	                 ShadePath *path=0, float *shadows=0, bool reused=false) const;
+
+    // direct color plus the reflected and refracted colors at ray
+    // intersection, tracing their rays, recorded on path if given, as
+    // color does after the lights
+    const Vec3 secondary(const World &w, const Ray &r, const HitRecord &hit,
+                         const Vec3 &direct, ShadePath *path=0) const;
+
+protected: // shading helpers
+    // diffuse and specular contribution of one light, including its shadow ray
+    // the light's visibility is stored to visibility if given, or if
+    // recorded, read from it instead of tracing shadow rays
+    const Vec3 lightColor(const World &w, const Light &li,
+                          const Vec3 &P, const Vec3 &N, const Vec3 &V,
+                          float *visibility=0, bool recorded=false) const;
 };
 
 #endif
@@ -5,10 +5,14 @@
 // everything it needs for internal self-consistency
 #include "ObjectList.hpp"
 #include "Object.hpp"
+#include "TileDeps.hpp"
 #include <iostream>
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 
 static std::atomic<int> RayCount(0), ShadowCount(0);
+static thread_local uint64_t ThreadTests = 0, ThreadShadows = 0;
 
 // delete list and objects it contains
 ObjectList::~ObjectList() {
@@ -18,30 +22,178 @@ ObjectList::~ObjectList() {
         delete obj;
 }
 
+// add object, numbering it by its position in the list
+void
+ObjectList::addObject(Object *obj)
+{
+    obj->id = int(objects.size());
+    objects.push_back(obj);
+}
+
+// delete objects
+void
+ObjectList::clear()
+{
+    for(auto obj : objects)
+        delete obj;
+    objects.clear();
+    accel = LIST;
+    bvh = Bvh();
+    qbvh = QBvh();
+}
+
+// build acceleration structure
+void
+ObjectList::build(Accel kind, int passes, ThreadPool *pool)
+{
+    accel = kind;
+    treelets = passes;
+    bvh = Bvh();
+    qbvh = QBvh();
+    if (kind == LBVH) {
+        bvh.build(objects, passes, pool);
+        bvh.stats(std::cout);
+    }
+    else if (kind == QBVH) {
+        qbvh.build(objects, passes, pool);
+        qbvh.stats(std::cout);
+    }
+}
+
+// refit or rebuild after objects moved
+bool
+ObjectList::update(const std::vector<int> &moved, float limit, ThreadPool *pool)
+{
+    if (accel == LIST || moved.empty())
+        return false;
+    if (accel == QBVH) {
+        qbvh.build(objects, treelets, pool);
+        return true;
+    }
+
+    bvh.refit(objects, moved);
+    if (costGrowth() <= limit)
+        return false;
+    bvh.build(objects, treelets, pool);
+    return true;
+}
+
+// LBVH cost now against as built
+float
+ObjectList::costGrowth() const
+{
+    if (accel != LBVH || bvh.builtCost() <= 0) return 1;
+    return bvh.cost() / bvh.builtCost();
+}
+
+// parse acceleration structure name
+bool
+ObjectList::parseAccel(const char *name, Accel &kind)
+{
+    if (strcmp(name, "list") == 0)      kind = LIST;
+    else if (strcmp(name, "lbvh") == 0) kind = LBVH;
+    else if (strcmp(name, "qbvh") == 0) kind = QBVH;
+    else return false;
+    return true;
+}
+
 // trace ray r through all objects, returning first intersection
 const Intersection
-ObjectList::trace(Ray r) const
+ObjectList::trace(Ray r, HitRecord *hit) const
 {
     ++RayCount;
     Intersection closest;       // no object, t = infinity
-    for(auto obj : objects) {
-        Intersection current = obj->intersect(r);
-        if (current < closest)
-            closest = current;
+    float far = r.far;
+    if (accel == LBVH)
+        closest = bvh.trace(objects, r, ThreadTests);
+    else if (accel == QBVH)
+        closest = qbvh.trace(objects, r, ThreadTests);
+    else {
+        ThreadTests += objects.size();
+        for(auto obj : objects) {
+            Intersection current = obj->intersect(r);
+            if (current < closest) {
+                closest = current;
+                r.far = closest.t;  // anything farther can't be the closest
+            }
+        }
     }
+
+    // anything the ray reached, for the tile being traced if recording
+    TileDeps::touched(r, std::min(closest.t, far), closest.object() ? closest.object()->id : -1);
+
+    // only the final closest hit gets a full hit record
+    if (hit && closest.object())
+        closest.object()->hitRecord(r, closest, *hit);
     return closest;
 }
 
+// trace rays through all objects, interleaved with the LBVH
+void
+ObjectList::traceGroup(const Ray *rays, Intersection *hits, HitRecord *records,
+                       int count, int group) const
+{
+    if (accel != LBVH || group < 2) {
+        for(int k=0; k < count; ++k)
+            hits[k] = trace(rays[k], records ? &records[k] : 0);
+        return;
+    }
+
+    RayCount += count;
+    bvh.traceGroup(objects, rays, hits, count, group, ThreadTests);
+    for(int k=0; k < count; ++k)
+        TileDeps::touched(rays[k], std::min(hits[k].t, rays[k].far),
+                          hits[k].object() ? hits[k].object()->id : -1);
+    if (records)
+        for(int k=0; k < count; ++k)
+            if (hits[k].object())
+                hits[k].object()->hitRecord(rays[k], hits[k], records[k]);
+}
+
 // trace ray r through all objects, returning true if there is any
 // intersection between r.near and r.far
 const bool
 ObjectList::probe(Ray r) const
 {
     ++ShadowCount;
-    for(auto obj : objects) {
-        if (obj->intersect(r).t < r.far)
+    ++ThreadShadows;
+    if (accel == LBVH || accel == QBVH) {
+        int blocker = -1;
+        bool blocked = accel == LBVH ? bvh.probe(objects, r, ThreadTests, &blocker)
+                                     : qbvh.probe(objects, r, ThreadTests, &blocker);
+        TileDeps::touched(r, r.far, blocker);
+        return blocked;
+    }
+    for(size_t i=0; i < objects.size(); ++i) {
+        if (objects[i]->intersect(r).t < r.far) {
+            ThreadTests += i+1;
+            TileDeps::touched(r, r.far, int(i));
             return true;
+        }
     }
+    ThreadTests += objects.size();
+    TileDeps::touched(r, r.far, -1);
     return false;
 }
 
+
+// intersection tests by the calling thread
+uint64_t
+ObjectList::threadTests()
+{
+    return ThreadTests;
+}
+
+// shadow rays by the calling thread
+uint64_t
+ObjectList::threadShadows()
+{
+    return ThreadShadows;
+}
+
+// more intersection tests by the calling thread
+void
+ObjectList::countTests(uint64_t tests)
+{
+    ThreadTests += tests;
+}
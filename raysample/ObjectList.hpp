@@ -5,12 +5,16 @@
 // other classes we use DIRECTLY in our interface
 #include "Intersection.hpp"
 #include "Ray.hpp"
+#include "Bvh.hpp"
+#include "QBvh.hpp"
 
 // system includes
 #include <vector>
+#include <stdint.h>
 
 // classes we only use by pointer or reference
 class Object;
+class ThreadPool;
 
 class ObjectList {
 public: // data
@@ -18,22 +22,78 @@ public: // data
     typedef std::vector<Object*> ObjList;
     ObjList objects;
 
+    // acceleration structure for trace and probe
+    // LIST tests every object, LBVH walks a linear BVH, and QBVH a
+    // compressed 4-wide BVH collapsed from it
+    enum Accel { LIST, LBVH, QBVH };
+
+private: // private data
+    Accel accel;                    // structure in use
+    int treelets;                   // treelet passes it was built with
+    Bvh bvh;
+    QBvh qbvh;
+
 public: // constructor & destructor
-    ObjectList() {}
+    ObjectList() : accel(LIST), treelets(0) {}
     ~ObjectList();
 
 public:
     // Add an object to the list. Objects should be allocated with
     // new. Objects will be deleted when this ObjectList is destroyed
-    void addObject(Object *obj) { objects.push_back(obj); }
+    void addObject(Object *obj);
+
+    // delete all objects, leaving the list empty with no structure built
+    void clear();
+
+    // build acceleration structure kind over the objects, using pool's
+    // threads if given, with passes of treelet restructuring for LBVH
+    // prints build statistics
+    void build(Accel kind, int passes=0, ThreadPool *pool=0);
+
+    // true if the current structure is kind, built with passes
+    bool builtAs(Accel kind, int passes) const {
+        return accel == kind && (kind == LIST || treelets == passes);
+    }
+
+    // bring the structure up to date after the objects numbered in moved
+    // have moved: LBVH refits, unless the tree's surface area cost has
+    // grown past limit times its cost as built, QBVH rebuilds, and LIST
+    // has nothing to do; returns true if it rebuilt
+    bool update(const std::vector<int> &moved, float limit, ThreadPool *pool=0);
+
+    // surface area cost of the LBVH relative to the cost as built, 1 for
+    // the other structures
+    float costGrowth() const;
+
+    // parse "list", "lbvh", or "qbvh", returning false if unknown
+    static bool parseAccel(const char *name, Accel &kind);
 
 public: // computational members
     // trace ray r through all objects, returning first intersection
-    const Intersection trace(Ray r) const;
+    // if hit is given, also fill it in for that intersection
+    const Intersection trace(Ray r, HitRecord *hit=0) const;
+
+    // trace count rays through all objects, setting hits to their first
+    // intersections, and if records is given, filling it in for them
+    // with the LBVH, group rays at a time are interleaved, hiding the cache
+    // misses of each behind steps of the others
+    void traceGroup(const Ray *rays, Intersection *hits, HitRecord *records,
+                    int count, int group) const;
 
     // trace ray r through all objects, returning true if there is an
     // interesction between r.near and r.far
     const bool probe(Ray r) const;
+
+    // ray-object intersection tests so far by the calling thread, for
+    // cost estimates that come out the same on every run
+    static uint64_t threadTests();
+
+    // count tests made by the calling thread inside an object, such as
+    // an instance tracing its own geometry
+    static void countTests(uint64_t tests);
+
+    // shadow rays so far by the calling thread
+    static uint64_t threadShadows();
 };
 
 #endif
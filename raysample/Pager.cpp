@@ -0,0 +1,587 @@
+// implementation code for Pager and Cluster classes
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Pager.hpp"
+
+// other classes used directly in the implementation
+#include "ObjectList.hpp"
+#include "Polygon.hpp"
+#include "Sphere.hpp"
+#include "Ray.hpp"
+
+// system includes
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <cstring>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// file layout, all 4-byte aligned:
+//   header, with the World::POLYGONS and SPHERES bits the scene was
+//   parsed with
+//   surfaces: ambient, diffuse, specular, e, kr, kt, ir as 13 floats
+//   cluster table
+//   objects of each cluster: kind, surface, then for a sphere center and
+//   radius, for a polygon vertex count and vertices
+static const char Magic[8] = {'R','A','Y','P','A','G','E','2'};
+struct Header {
+    char magic[8];
+    uint32_t shapes;
+    uint32_t surfaces, clusters;
+};
+enum Kind { SPHERE, POLYGON };
+static const int SurfaceFloats = 13;
+
+// clusters past a missing one to ask the system to start reading, since
+// rays that reach one cluster tend to go on to its neighbors on the curve
+static const int ReadAhead = 4;
+
+// the pager and recent pages of the calling thread, told apart by the
+// serial number of the open they're from
+struct ThreadPages {
+    uint64_t serial;
+    void *recent;
+};
+static thread_local ThreadPages Current = { 0, 0 };
+static std::atomic<uint64_t> Opens(0);
+
+// whether data, bytes long, holds exactly count well-formed objects on
+// surfaces below surfaces
+static bool
+checkCluster(const char *data, uint32_t bytes, uint32_t count, uint32_t surfaces)
+{
+    if (bytes % 4) return false;
+    const uint32_t *word = (const uint32_t*)data;
+    uint64_t words = bytes / 4, at = 0;
+    for(uint32_t k=0; k < count; ++k) {
+        if (words - at < 3 || word[at+1] >= surfaces) return false;
+        uint64_t size;
+        if (word[at] == SPHERE) size = 6;
+        else if (word[at] == POLYGON) size = 3 + 3*uint64_t(word[at+2]);
+        else return false;
+        if (words - at < size) return false;
+        at += size;
+    }
+    return at == words;
+}
+
+// objects on surfaces
+Pager::Page::~Page()
+{
+    for(auto obj : objects)
+        delete obj;
+}
+
+// no pages yet
+Pager::Recent::Recent() : hits(0)
+{
+    for(int s=0; s < Slots; ++s) {
+        cluster[s] = -1;
+        generation[s] = 0;
+    }
+}
+
+// nothing mapped
+Pager::Pager()
+    : shapeBits(0), fd(-1), mapped(0), mappedBytes(0), cacheLimit(0), cacheBytes(0), peakBytes(0),
+      serial(0), hits(0), misses(0), evictions(0), bytesRead(0), bytesAhead(0)
+{}
+
+// unmap and delete shaders
+Pager::~Pager()
+{
+    close();
+}
+
+// write objects in clusters along the Morton order of a BVH's leaves, to
+// a temporary file renamed over filename once it's all on disk
+bool
+Pager::write(const std::string &filename, const std::vector<Object*> &objects,
+             int clusterSize, unsigned int shapes)
+{
+    // surfaces, each once
+    std::vector<float> surfaceData;
+    std::map<std::vector<float>, uint32_t> surfaceIndex;
+    std::vector<uint32_t> surfaceOf(objects.size());
+    for(size_t i=0; i < objects.size(); ++i) {
+        if (!dynamic_cast<const Sphere*>(objects[i]) && !dynamic_cast<const Polygon*>(objects[i])) {
+            std::cerr << "Only spheres and polygons can be paged\n";
+            return false;
+        }
+        const Surface &s = objects[i]->appearance();
+        std::vector<float> key = {s.ambient[0], s.ambient[1], s.ambient[2],
+                                  s.diffuse[0], s.diffuse[1], s.diffuse[2],
+                                  s.specular[0], s.specular[1], s.specular[2],
+                                  s.e, s.kr, s.kt, s.ir};
+        auto found = surfaceIndex.find(key);
+        if (found == surfaceIndex.end()) {
+            found = surfaceIndex.insert(std::make_pair(key, uint32_t(surfaceIndex.size()))).first;
+            surfaceData.insert(surfaceData.end(), key.begin(), key.end());
+        }
+        surfaceOf[i] = found->second;
+    }
+
+    // objects in the order of the BVH leaves
+    Bvh bvh;
+    bvh.build(objects, 0, 0);
+    int n = int(objects.size());
+    std::vector<int> order(n);
+    for(int i=0; i < n; ++i)
+        order[i] = bvh.tree()[n-1 + i].right;
+
+    // cluster bounds and where their objects go
+    Header header;
+    memcpy(header.magic, Magic, sizeof(Magic));
+    header.shapes = shapes;
+    header.surfaces = uint32_t(surfaceIndex.size());
+    header.clusters = uint32_t((n + clusterSize - 1) / clusterSize);
+    std::vector<ClusterInfo> table(header.clusters);
+    uint64_t offset = sizeof(Header) + surfaceData.size() * sizeof(float)
+        + table.size() * sizeof(ClusterInfo);
+    for(int c=0; c < int(table.size()); ++c) {
+        ClusterInfo &info = table[c];
+        info.offset = offset;
+        info.bytes = 0;
+        info.count = uint32_t(std::min(clusterSize, n - c*clusterSize));
+        for(uint32_t k=0; k < info.count; ++k) {
+            const Object *obj = objects[order[c*clusterSize + k]];
+            const Polygon *poly = dynamic_cast<const Polygon*>(obj);
+            info.bytes += uint32_t(poly ? 3*4 + poly->vertexCount() * 3*4 : 6*4);
+
+            Vec3 lo, hi;
+            obj->bounds(lo, hi);
+            for(int a=0; a < 3; ++a) {
+                info.lo[a] = k ? std::min(info.lo[a], lo[a]) : lo[a];
+                info.hi[a] = k ? std::max(info.hi[a], hi[a]) : hi[a];
+            }
+        }
+        offset += info.bytes;
+    }
+
+    std::string temp = filename + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if (!out) return false;
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(surfaceData.data(), sizeof(float), surfaceData.size(), out);
+    fwrite(table.data(), sizeof(ClusterInfo), table.size(), out);
+    std::vector<uint32_t> record;
+    for(int i=0; i < n; ++i) {
+        const Object *obj = objects[order[i]];
+        record.clear();
+        if (const Sphere *sphere = dynamic_cast<const Sphere*>(obj)) {
+            float data[4] = {sphere->center()[0], sphere->center()[1], sphere->center()[2],
+                             sphere->radius()};
+            record.resize(2 + 4);
+            record[0] = SPHERE;
+            memcpy(&record[2], data, sizeof(data));
+        }
+        else {
+            const Polygon *poly = static_cast<const Polygon*>(obj);
+            size_t count = poly->vertexCount();
+            record.resize(3 + 3*count);
+            record[0] = POLYGON;
+            record[2] = uint32_t(count);
+            for(size_t v=0; v < count; ++v) {
+                float data[3] = {poly->vertex(v)[0], poly->vertex(v)[1], poly->vertex(v)[2]};
+                memcpy(&record[3 + 3*v], data, sizeof(data));
+            }
+        }
+        record[1] = surfaceOf[order[i]];
+        fwrite(record.data(), sizeof(uint32_t), record.size(), out);
+    }
+
+    // the data must be on disk before the rename makes it the page file
+    bool ok = fflush(out) == 0 && !ferror(out);
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(out)) == 0;
+#else
+    ok = ok && fsync(fileno(out)) == 0;
+#endif
+    fclose(out);
+#ifdef _WIN32
+    ::remove(filename.c_str());      // Windows rename won't replace a file
+#endif
+    if (!ok || rename(temp.c_str(), filename.c_str()) != 0) {
+        ::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// map the file and read its tables, after reading it through once to
+// check that the tables fit it and every cluster's objects are whole, so
+// decoding can trust them
+bool
+Pager::open(const std::string &filename, size_t cacheBytes)
+{
+    close();
+    cacheLimit = cacheBytes;
+
+    // header and tables, read through the file so they are never paged out
+#ifdef _WIN32
+    fd = _open(filename.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    fd = ::open(filename.c_str(), O_RDONLY);
+#endif
+    if (fd < 0) return false;
+    struct stat info;
+    std::ifstream in(filename, std::ios::binary);
+    Header header;
+    if (stat(filename.c_str(), &info) != 0 || !in.read((char*)&header, sizeof(header)) ||
+            memcmp(header.magic, Magic, sizeof(Magic)) != 0) {
+        close();
+        return false;
+    }
+    uint64_t fileBytes = uint64_t(info.st_size);
+    uint64_t end = sizeof(Header) + uint64_t(header.surfaces) * SurfaceFloats * sizeof(float)
+        + uint64_t(header.clusters) * sizeof(ClusterInfo);
+    if (end > fileBytes) {
+        close();
+        return false;
+    }
+    std::vector<float> surfaceData(size_t(header.surfaces) * SurfaceFloats);
+    clusters.resize(header.clusters);
+    in.read((char*)surfaceData.data(), surfaceData.size() * sizeof(float));
+    in.read((char*)clusters.data(), clusters.size() * sizeof(ClusterInfo));
+    if (!in) {
+        close();
+        return false;
+    }
+
+    // clusters follow the tables back to back to the end of the file
+    std::vector<char> data;
+    for(auto &cluster : clusters) {
+        if (cluster.offset != end || cluster.bytes > fileBytes - end) {
+            close();
+            return false;
+        }
+        data.resize(cluster.bytes);
+        if (!in.read(data.data(), cluster.bytes) ||
+                !checkCluster(data.data(), cluster.bytes, cluster.count, header.surfaces)) {
+            close();
+            return false;
+        }
+        end += cluster.bytes;
+    }
+    if (end != fileBytes) {
+        close();
+        return false;
+    }
+    shapeBits = header.shapes;
+
+    for(uint32_t s=0; s < header.surfaces; ++s) {
+        const float *f = &surfaceData[s * SurfaceFloats];
+        Surface surface;
+        surface.ambient = Vec3(f[0], f[1], f[2]);
+        surface.diffuse = Vec3(f[3], f[4], f[5]);
+        surface.specular = Vec3(f[6], f[7], f[8]);
+        surface.e = f[9];
+        surface.kr = f[10];
+        surface.kt = f[11];
+        surface.ir = f[12];
+        surfaces.push_back(surface);
+        shaders.push_back(new Sphere(surface, Vec3(0,0,0), 0));
+    }
+    int objects = 0;
+    for(auto &info : clusters) {
+        firstObject.push_back(objects);
+        objects += int(info.count);
+    }
+
+#ifndef _WIN32
+    mappedBytes = size_t(fileBytes);
+    void *map = mappedBytes ? mmap(0, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED) {
+        close();
+        return false;
+    }
+    mapped = (const char*)map;
+#endif
+
+    resident.assign(clusters.size(), std::shared_ptr<const Page>());
+    position.assign(clusters.size(), lru.end());
+    loading.assign(clusters.size(), 0);
+    generation.reset(new std::atomic<uint32_t>[clusters.size()]);
+    used.reset(new std::atomic<uint8_t>[clusters.size()]);
+    for(size_t c=0; c < clusters.size(); ++c) {
+        generation[c] = 0;
+        used[c] = 0;
+    }
+    serial = ++Opens;
+    return true;
+}
+
+// unmap and forget everything
+void
+Pager::close()
+{
+#ifdef _WIN32
+    if (fd >= 0) _close(fd);
+#else
+    if (mapped) munmap((void*)mapped, mappedBytes);
+    if (fd >= 0) ::close(fd);
+#endif
+    fd = -1;
+    shapeBits = 0;
+    mapped = 0;
+    mappedBytes = 0;
+    for(auto obj : shaders)
+        delete obj;
+    shaders.clear();
+    surfaces.clear();
+    clusters.clear();
+    firstObject.clear();
+    resident.clear();
+    position.clear();
+    lru.clear();
+    loading.clear();
+    generation.reset();
+    used.reset();
+    threads.clear();
+    serial = 0;
+    cacheBytes = peakBytes = 0;
+    hits = misses = evictions = bytesRead = bytesAhead = 0;
+}
+
+// one Cluster object per cluster
+void
+Pager::addClusters(ObjectList &list)
+{
+    for(int c=0; c < int(clusters.size()); ++c) {
+        const ClusterInfo &info = clusters[c];
+        list.addObject(new Cluster(*this, c, Vec3(info.lo[0], info.lo[1], info.lo[2]),
+                                   Vec3(info.hi[0], info.hi[1], info.hi[2])));
+    }
+}
+
+// decode objects of cluster c
+// on systems with mmap, the file pages it came from are dropped after,
+// so only the decoded cache counts against memory, and the next clusters
+// are read ahead
+// runs without the lock, so only reads what other threads don't change
+std::shared_ptr<const Pager::Page>
+Pager::load(int c, uint64_t &ahead)
+{
+    const ClusterInfo &info = clusters[c];
+    const char *data;
+    ahead = 0;
+#ifdef _WIN32
+    std::vector<char> buffer(info.bytes);
+    {
+        std::lock_guard<std::mutex> guard(reading);
+        _lseeki64(fd, info.offset, SEEK_SET);
+        _read(fd, buffer.data(), info.bytes);
+    }
+    data = buffer.data();
+#else
+    data = mapped + info.offset;
+#endif
+
+    std::shared_ptr<Page> page(new Page);
+    page->bytes = sizeof(Page);
+    const uint32_t *word = (const uint32_t*)data;
+    for(uint32_t k=0; k < info.count; ++k) {
+        uint32_t kind = word[0], surface = word[1];
+        Object *obj;
+        if (kind == SPHERE) {
+            float f[4];
+            memcpy(f, word + 2, sizeof(f));
+            obj = new Sphere(surfaces[surface], Vec3(f[0], f[1], f[2]), f[3]);
+            page->bytes += sizeof(Sphere);
+            word += 6;
+        }
+        else {
+            uint32_t count = word[2];
+            Polygon *poly = new Polygon(surfaces[surface]);
+            for(uint32_t v=0; v < count; ++v) {
+                float f[3];
+                memcpy(f, word + 3 + 3*v, sizeof(f));
+                poly->addVertex(Vec3(f[0], f[1], f[2]));
+            }
+            poly->closePolygon();
+            obj = poly;
+            page->bytes += sizeof(Polygon) + count * 2*sizeof(Vec3);
+            word += 3 + 3*count;
+        }
+        obj->id = int(k);
+        page->objects.push_back(obj);
+        page->surfaces.push_back(int(surface));
+    }
+    page->bvh.build(page->objects, 0, 0);
+    page->bytes += page->bvh.bytes() + info.count * (sizeof(Object*) + sizeof(int));
+
+#ifndef _WIN32
+    // drop whole file pages inside this cluster
+    size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    size_t start = (info.offset + pageSize - 1) / pageSize * pageSize;
+    size_t end = (info.offset + info.bytes) / pageSize * pageSize;
+    if (start < end)
+        madvise((void*)(mapped + start), end - start, MADV_DONTNEED);
+
+    // start reading the next clusters that aren't here
+    size_t aheadStart = info.offset + info.bytes, aheadEnd = aheadStart;
+    for(int a = c+1; a < int(clusters.size()) && a <= c + ReadAhead; ++a)
+        if (!(generation[a].load(std::memory_order_relaxed) & 1)) {
+            aheadEnd = clusters[a].offset + clusters[a].bytes;
+            ahead += clusters[a].bytes;
+        }
+    start = aheadStart / pageSize * pageSize;
+    if (start < aheadEnd)
+        madvise((void*)(mapped + start), aheadEnd - start, MADV_WILLNEED);
+#endif
+    return page;
+}
+
+// the thread's recent pages if they're still resident, without the lock,
+// or else the cache's, kept as the thread's most recent
+const Pager::Page *
+Pager::fetch(int c)
+{
+    Recent *pages = recent();
+    int s = c % Slots;
+    if (pages->cluster[s] == c &&
+            generation[c].load(std::memory_order_acquire) == pages->generation[s]) {
+        pages->hits.store(pages->hits.load(std::memory_order_relaxed) + 1,
+                          std::memory_order_relaxed);
+        if (!used[c].load(std::memory_order_relaxed))
+            used[c].store(1, std::memory_order_relaxed);
+        return pages->page[s].get();
+    }
+
+    uint32_t current;
+    pages->page[s] = lookup(c, current);
+    pages->cluster[s] = c;
+    pages->generation[s] = current;
+    return pages->page[s].get();
+}
+
+// the thread's own, or new ones if they're from another open
+Pager::Recent *
+Pager::recent()
+{
+    if (Current.serial == serial)
+        return (Recent*)Current.recent;
+
+    std::lock_guard<std::mutex> guard(lock);
+    threads.push_back(std::unique_ptr<Recent>(new Recent));
+    Current.serial = serial;
+    Current.recent = threads.back().get();
+    return threads.back().get();
+}
+
+// cached page for cluster c, or read in without the lock, then inserted
+// after evicting the least recently used pages to stay within the limit
+// pages marked used since they were last moved up are moved to the front
+// instead, each at most once, as other threads may keep marking them
+std::shared_ptr<const Pager::Page>
+Pager::lookup(int c, uint32_t &current)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (loading[c])
+        ready.wait(guard);
+    if (resident[c]) {
+        ++hits;
+        lru.splice(lru.begin(), lru, position[c]);
+        used[c].store(0, std::memory_order_relaxed);
+        current = generation[c].load(std::memory_order_relaxed);
+        return resident[c];
+    }
+
+    ++misses;
+    loading[c] = 1;
+    guard.unlock();
+    uint64_t ahead;
+    std::shared_ptr<const Page> page = load(c, ahead);
+    guard.lock();
+
+    bytesRead += clusters[c].bytes;
+    bytesAhead += ahead;
+    size_t chances = lru.size();
+    while (!lru.empty() && cacheBytes + page->bytes > cacheLimit) {
+        int oldest = lru.back();
+        if (chances > 0 && used[oldest].load(std::memory_order_relaxed)) {
+            --chances;
+            used[oldest].store(0, std::memory_order_relaxed);
+            lru.splice(lru.begin(), lru, position[oldest]);
+            continue;
+        }
+        cacheBytes -= resident[oldest]->bytes;
+        resident[oldest].reset();
+        generation[oldest].fetch_add(1, std::memory_order_release);
+        position[oldest] = lru.end();
+        lru.pop_back();
+        ++evictions;
+    }
+    resident[c] = page;
+    lru.push_front(c);
+    position[c] = lru.begin();
+    used[c].store(0, std::memory_order_relaxed);
+    cacheBytes += page->bytes;
+    peakBytes = std::max(peakBytes, cacheBytes);
+    current = generation[c].fetch_add(1, std::memory_order_release) + 1;
+
+    loading[c] = 0;
+    ready.notify_all();
+    return page;
+}
+
+// cache and file statistics
+void
+Pager::stats(std::ostream &out) const
+{
+    uint64_t recentHits = 0;
+    for(auto &pages : threads)
+        recentHits += pages->hits.load(std::memory_order_relaxed);
+    uint64_t found = hits + recentHits, lookups = found + misses;
+    out << "Paged " << (firstObject.empty() ? 0 : firstObject.back() + clusters.back().count)
+        << " objects in " << clusters.size() << " clusters; cache limit "
+        << cacheLimit / (1024*1024.) << " MB, peak " << peakBytes / (1024*1024.) << " MB\n"
+        << "  " << (lookups ? 100. * found / lookups : 0) << "% hit rate (" << found
+        << " hits, " << recentHits << " of them without the lock, " << misses
+        << " misses, " << evictions << " evictions)\n"
+        << "  read " << bytesRead / (1024*1024.) << " MB of " << mappedBytes / (1024*1024.)
+        << " MB page file, asked for " << bytesAhead / (1024*1024.)
+        << " MB of read-ahead\n";
+}
+
+// closest hit among the cluster's objects
+const Intersection
+Cluster::intersect(const Ray &ray) const
+{
+    const Pager::Page *page = pager.fetch(cluster);
+    uint64_t tests = 0;
+    Intersection closest = page->bvh.trace(page->objects, ray, tests);
+    ObjectList::countTests(tests);
+    if (!closest.object()) return closest;
+
+    Intersection isect(this, closest.t, closest.u, closest.v);
+    isect.part = closest.object()->id;
+    return isect;
+}
+
+// the hit object's own record, numbered by its place in the page file
+void
+Cluster::hitRecord(const Ray &ray, const Intersection &isect, HitRecord &hit) const
+{
+    const Pager::Page *page = pager.fetch(cluster);
+    const Object *obj = page->objects[isect.part];
+    obj->hitRecord(ray, Intersection(obj, isect.t, isect.u, isect.v), hit);
+    hit.prim = pager.first(cluster) + isect.part;
+}
+
+// the resident object with the hit object's surface
+const Object *
+Cluster::shader(int part) const
+{
+    return pager.shader(pager.fetch(cluster)->surfaces[part]);
+}
@@ -0,0 +1,185 @@
+// out-of-core geometry: clusters of objects paged in from a mapped file
+#ifndef PAGER_HPP
+#define PAGER_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Object.hpp"
+#include "Bvh.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <list>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+
+// classes we only use by pointer or reference
+class ObjectList;
+
+// page file of spheres and polygons in clusters, each a run of objects
+// along a Morton curve, so each covers a compact part of the scene
+// the scene's objects are replaced by one Cluster object per cluster, so
+// the top levels of the acceleration structure are built over clusters and
+// stay in memory; a ray reaching a cluster faults its objects in from the
+// file, through a least-recently-used cache with a limit on the memory the
+// decoded objects take
+// each thread keeps its last few pages, and finds them again without the
+// lock for as long as they stay resident, only marking them used; eviction
+// gives a used page a second chance at the front of the list instead of
+// evicting it, so pages found this way age as if they'd been looked up; a
+// thread's recent page can outlast its eviction until the thread replaces it
+// a miss is decoded outside the lock, which is only held to look up,
+// evict, and insert pages, and threads wanting the same cluster wait for
+// the one reading it
+class Pager {
+public: // public types
+    // objects of one cluster, decoded, with a BVH over them
+    struct Page {
+        std::vector<Object*> objects;   // object i has id i
+        std::vector<int> surfaces;      // index of each object's surface
+        Bvh bvh;
+        size_t bytes;                   // about, for the cache limit
+        ~Page();
+    };
+
+private: // private types
+    // a thread's recently used pages, by cluster number modulo Slots, and
+    // the generation each was resident in
+    static const int Slots = 8;
+    struct Recent {
+        int cluster[Slots];
+        uint32_t generation[Slots];
+        std::shared_ptr<const Page> page[Slots];
+        std::atomic<uint64_t> hits;     // written only by its thread
+        char pad[64];                   // keeps other threads' hits off its cache line
+
+        Recent();
+    };
+
+private: // private data
+    // from the file
+    struct ClusterInfo {
+        float lo[3], hi[3];
+        uint64_t offset;                // of its objects in the file
+        uint32_t bytes, count;
+    };
+    std::vector<Surface> surfaces;
+    std::vector<ClusterInfo> clusters;
+    std::vector<int> firstObject;       // number of each cluster's first object
+    unsigned int shapeBits;             // World::POLYGONS and SPHERES when written
+
+    // the mapped file, or on systems without mmap, the open file
+    int fd;
+    const char *mapped;
+    size_t mappedBytes;
+
+    // objects that only shade, never traced: one per surface
+    std::vector<Object*> shaders;
+
+    // resident pages, most recently used at the front of lru, and
+    // clusters being read in, guarded by lock
+    std::mutex lock;
+    std::condition_variable ready;      // a cluster finished reading
+    size_t cacheLimit, cacheBytes, peakBytes;
+    std::vector<std::shared_ptr<const Page> > resident;
+    std::vector<std::list<int>::iterator> position;
+    std::list<int> lru;
+    std::vector<char> loading;
+
+    // read without the lock: for each cluster, a count of the times it was
+    // made resident or evicted, odd while it's resident, and whether it
+    // was found in a thread's recent pages since it was last moved up lru
+    std::unique_ptr<std::atomic<uint32_t>[]> generation;
+    std::unique_ptr<std::atomic<uint8_t>[]> used;
+
+    // every thread's recent pages, added to under lock, for this open
+    uint64_t serial;
+    std::vector<std::unique_ptr<Recent> > threads;
+
+#ifdef _WIN32
+    std::mutex reading;                 // reads seek the shared file
+#endif
+
+    // statistics, except hits on recent pages
+    uint64_t hits, misses, evictions, bytesRead, bytesAhead;
+
+public: // constructor & destructor
+    Pager();
+    ~Pager();
+
+public: // manipulators
+    // write objects, which must all be spheres or polygons, to filename
+    // clustered by at most clusterSize objects, noting the shapes, the
+    // World::POLYGONS and SPHERES bits, they were parsed with; false if
+    // it can't, leaving any file already there as it was
+    static bool write(const std::string &filename, const std::vector<Object*> &objects,
+                      int clusterSize, unsigned int shapes);
+
+    // map filename, decoding at most cacheBytes of objects at a time
+    // false if it can't be read, isn't a page file, or is cut short or
+    // has clusters that don't match their objects
+    bool open(const std::string &filename, size_t cacheBytes);
+
+    // add a Cluster object to list for each cluster
+    void addClusters(ObjectList &list);
+
+public: // computational members
+    // objects of cluster c, read in if they aren't resident
+    // the page lasts until the calling thread fetches again
+    const Page *fetch(int c);
+
+    // object to shade with surface s
+    const Object *shader(int s) const { return shaders[s]; }
+
+    // number of cluster c's first object
+    int first(int c) const { return firstObject[c]; }
+
+    // shapes the open file's objects were parsed with
+    unsigned int shapes() const { return shapeBits; }
+
+    // print cache hit rate, bytes read, and peak memory
+    void stats(std::ostream &out) const;
+
+private: // internal helpers
+    // the calling thread's recent pages, adding them if it has none
+    Recent *recent();
+
+    // cached page for cluster c and the generation it's resident in,
+    // read in if needed
+    std::shared_ptr<const Page> lookup(int c, uint32_t &current);
+
+    // decode cluster c from the file, setting ahead to the bytes of read
+    // ahead asked for after it
+    std::shared_ptr<const Page> load(int c, uint64_t &ahead);
+
+    void close();
+};
+
+// stand-in for the objects of one cluster, paging them in when hit
+// hits record the object's position in the cluster as the part, and hit
+// records and shading look the cluster up again, since it may have been
+// evicted in between
+class Cluster : public Object {
+private: // private data
+    Pager &pager;
+    int cluster;
+    Vec3 lo, hi;
+
+public: // constructors
+    Cluster(Pager &_pager, int _cluster, const Vec3 &_lo, const Vec3 &_hi)
+        : pager(_pager), cluster(_cluster), lo(_lo), hi(_hi) {}
+
+public: // object functions
+    const Intersection intersect(const Ray &ray) const override;
+    void hitRecord(const Ray &ray, const Intersection &isect,
+                   HitRecord &hit) const override;
+    void bounds(Vec3 &_lo, Vec3 &_hi) const override { _lo = lo; _hi = hi; }
+    void move(const Transform &) override {}   // clusters stay put
+    const Object *shader(int part) const override;
+};
+
+#endif
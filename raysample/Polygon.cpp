@@ -8,6 +8,7 @@
 #include "World.hpp"
 #include "Ray.hpp"
 #include "Intersection.hpp"
+#include "Transform.hpp"
 
 void
 Polygon::addVertex(const Vec3 v)
@@ -67,12 +68,36 @@ Polygon::intersect(const Ray &ray) const
         }
     }
 
-    if (inside) return Intersection(this,t);
+    // keep plane coordinates for the hit record
+    if (inside) return Intersection(this,t, Pt,Pb);
 
     return Intersection();
 }
 
-const Vec3 Polygon::normal(const Vec3 P) const
+// position, face normal, and plane coordinates already found by intersect
+void Polygon::hitRecord(const Ray &ray, const Intersection &isect, HitRecord &hit) const
 {
-    return N;
+    hit.P = fma(isect.t, ray.D, ray.E);
+    hit.N = N;
+    hit.prim = id;
+    hit.u = isect.u;
+    hit.v = isect.v;
+}
+
+// extent of the vertices
+void Polygon::bounds(Vec3 &lo, Vec3 &hi) const
+{
+    lo = hi = vertices[0].V;
+    for(auto &vert : vertices) {
+        lo = min(lo, vert.V);
+        hi = max(hi, vert.V);
+    }
+}
+
+// moved vertices, and the plane and basis recomputed from them
+void Polygon::move(const Transform &t)
+{
+    for(auto &vert : vertices)
+        vert.V = t.point(vert.V);
+    closePolygon();
 }
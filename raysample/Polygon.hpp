@@ -45,9 +45,16 @@ public: // manipulators
     // close the polygon after the last vertex
     void closePolygon();
 
+public: // accessors
+    size_t vertexCount() const { return vertices.size(); }
+    const Vec3 &vertex(size_t i) const { return vertices[i].V; }
+
 public: // object functions
     const Intersection intersect(const Ray &ray) const override;
-    const Vec3 normal(const Vec3 P) const override;
+    void hitRecord(const Ray &ray, const Intersection &isect,
+                   HitRecord &hit) const override;
+    void bounds(Vec3 &lo, Vec3 &hi) const override;
+    void move(const Transform &t) override;
 };
 
 #endif
@@ -0,0 +1,327 @@
+// implementation code for QBvh class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "QBvh.hpp"
+
+// other classes used directly in the implementation
+#include "Bvh.hpp"
+#include "Object.hpp"
+#include "Ray.hpp"
+
+// system includes
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+// child slot with nothing in it
+static const int Empty = INT_MIN;
+
+// traversal stack entries: each level down leaves at most three siblings
+// waiting, and the tree is no deeper than the linear BVH's 62 levels
+static const int StackSize = 3*64;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// power of two step so 255 steps cover extent
+// steps times a power of two are exact, so decoding rounds only once
+static float
+stepFor(float extent)
+{
+    if (!(extent > 0)) return 1;
+    int exponent;
+    frexpf(extent / 255, &exponent);
+    return ldexpf(1, exponent);
+}
+
+// true if step q decodes to at or below (or above) value, whether or not
+// the compiler fuses the multiply and add when decoding
+static inline bool
+decodesBelow(int q, float origin, float scale, float value)
+{
+    return origin + float(q) * scale <= value && fmaf(float(q), scale, origin) <= value;
+}
+static inline bool
+decodesAbove(int q, float origin, float scale, float value)
+{
+    return origin + float(q) * scale >= value && fmaf(float(q), scale, origin) >= value;
+}
+
+// highest step at or below value, and lowest step at or above it
+static uint8_t
+quantizeDown(float value, float origin, float scale)
+{
+    int q = std::max(0, std::min(255, int(floorf((value - origin) / scale))));
+    while (q > 0 && !decodesBelow(q, origin, scale, value))
+        --q;
+    return uint8_t(q);
+}
+static uint8_t
+quantizeUp(float value, float origin, float scale)
+{
+    int q = std::max(0, std::min(255, int(ceilf((value - origin) / scale))));
+    while (q < 255 && !decodesAbove(q, origin, scale, value))
+        ++q;
+    return uint8_t(q);
+}
+
+// half the surface area of a linear BVH node
+static inline float
+halfArea(const Bvh::Node &node)
+{
+    float dx = node.hi[0] - node.lo[0], dy = node.hi[1] - node.lo[1],
+        dz = node.hi[2] - node.lo[2];
+    return dx*dy + dy*dz + dz*dx;
+}
+
+// rebuild for objects
+void
+QBvh::build(const std::vector<Object*> &list, int treelets, ThreadPool *pool)
+{
+    Bvh binary;
+    binary.build(list, treelets, pool);
+    binaryTime = binary.buildSeconds();
+    binaryBytes = binary.bytes();
+
+    auto startTime = Clock::now();
+    const std::vector<Bvh::Node> &tree = binary.tree();
+    objects = int(list.size());
+    nodes.clear();
+    if (tree.empty()) return;
+    nodes.reserve(tree.size() / 3 + 1);
+
+    // linear BVH node for each node still to fill in
+    std::vector<std::pair<int,int> > todo(1, std::make_pair(0, 0));
+    nodes.push_back(Node());
+    while (!todo.empty()) {
+        int from = todo.back().first, index = todo.back().second;
+        todo.pop_back();
+        const Bvh::Node &parent = tree[from];
+
+        // open the largest internal child until there are four
+        int children[4], count = 0;
+        if (parent.left < 0)
+            children[count++] = from;       // a lone object
+        else {
+            children[count++] = parent.left;
+            children[count++] = parent.right;
+        }
+        while (count < 4) {
+            int largest = -1;
+            float largestArea = -1;
+            for(int c=0; c < count; ++c) {
+                float area = halfArea(tree[children[c]]);
+                if (tree[children[c]].left >= 0 && area > largestArea) {
+                    largest = c;
+                    largestArea = area;
+                }
+            }
+            if (largest < 0) break;
+            const Bvh::Node &open = tree[children[largest]];
+            children[largest] = open.left;
+            children[count++] = open.right;
+        }
+
+        // steps from the low corner, wide enough to reach the high corner
+        Node node;
+        for(int k=0; k < 3; ++k) {
+            node.origin[k] = parent.lo[k];
+            node.scale[k] = stepFor(parent.hi[k] - parent.lo[k]);
+            while (!decodesAbove(255, node.origin[k], node.scale[k], parent.hi[k]))
+                node.scale[k] *= 2;
+        }
+
+        for(int c=0; c < 4; ++c) {
+            if (c >= count) {
+                for(int k=0; k < 3; ++k) {
+                    node.lo[k][c] = 255;
+                    node.hi[k][c] = 0;
+                }
+                node.child[c] = Empty;
+                continue;
+            }
+
+            const Bvh::Node &child = tree[children[c]];
+            for(int k=0; k < 3; ++k) {
+                node.lo[k][c] = quantizeDown(child.lo[k], node.origin[k], node.scale[k]);
+                node.hi[k][c] = quantizeUp(child.hi[k], node.origin[k], node.scale[k]);
+            }
+            if (child.left < 0)
+                node.child[c] = ~child.right;
+            else {
+                node.child[c] = int(nodes.size());
+                nodes.push_back(Node());
+                todo.push_back(std::make_pair(children[c], node.child[c]));
+            }
+        }
+        nodes[index] = node;
+    }
+
+    std::chrono::duration<double> collapsing = Clock::now() - startTime;
+    collapseTime = collapsing.count();
+}
+
+#if FLOAT4_SSE
+// four bytes widened to four floats
+static inline __m128
+bytesToFloats(const uint8_t bytes[4])
+{
+    int32_t packed;
+    memcpy(&packed, bytes, 4);
+    __m128i zero = _mm_setzero_si128();
+    __m128i wide = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(wide, zero));
+}
+#endif
+
+// entry distance t of a ray into each child of node, between near and far
+// E and invD are the ray start and reciprocal direction, one axis in each
+// with the same value in every lane
+// returns a bit for each child hit
+// like the linear BVH, the exit is pushed out by a few rounding errors
+int
+QBvh::hitChildren(const Node &node, const float4 E[3], const float4 invD[3],
+                  float near, float far, float t[4]) const
+{
+#if FLOAT4_SSE
+    __m128 tmin = _mm_set1_ps(near), tmax = _mm_set1_ps(INFINITY);
+    for(int k=0; k < 3; ++k) {
+        __m128 origin = _mm_set1_ps(node.origin[k]), scale = _mm_set1_ps(node.scale[k]);
+        __m128 lo = _mm_add_ps(_mm_mul_ps(bytesToFloats(node.lo[k]), scale), origin);
+        __m128 hi = _mm_add_ps(_mm_mul_ps(bytesToFloats(node.hi[k]), scale), origin);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, E[k].m), invD[k].m);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(hi, E[k].m), invD[k].m);
+        tmin = _mm_max_ps(tmin, _mm_min_ps(t0, t1));
+        tmax = _mm_min_ps(tmax, _mm_max_ps(t0, t1));
+    }
+    tmax = _mm_min_ps(_mm_mul_ps(tmax, _mm_set1_ps(1.0000008f)), _mm_set1_ps(far));
+    __m128 empty = _mm_castsi128_ps(_mm_cmpeq_epi32(
+        _mm_loadu_si128((const __m128i*)node.child), _mm_set1_epi32(Empty)));
+    _mm_storeu_ps(t, tmin);
+    return _mm_movemask_ps(_mm_andnot_ps(empty, _mm_cmple_ps(tmin, tmax)));
+#else
+    int mask = 0;
+    for(int c=0; c < 4; ++c) {
+        if (node.child[c] == Empty) continue;
+        float tmin = near, tmax = INFINITY;
+        for(int k=0; k < 3; ++k) {
+            float lo = node.origin[k] + float(node.lo[k][c]) * node.scale[k];
+            float hi = node.origin[k] + float(node.hi[k][c]) * node.scale[k];
+            float t0 = (lo - E[k][0]) * invD[k][0], t1 = (hi - E[k][0]) * invD[k][0];
+            tmin = std::max(tmin, std::min(t0, t1));
+            tmax = std::min(tmax, std::max(t0, t1));
+        }
+        t[c] = tmin;
+        if (tmin <= std::min(tmax * 1.0000008f, far))
+            mask |= 1 << c;
+    }
+    return mask;
+#endif
+}
+
+// closest intersection of r with objects
+// objects among the children hit are tested right away, and child nodes
+// are visited nearest first
+const Intersection
+QBvh::trace(const std::vector<Object*> &list, Ray r, uint64_t &tests) const
+{
+    Intersection closest;       // no object, t = infinity
+    if (nodes.empty()) return closest;
+
+    Vec3 inverse = Vec3(1, 1, 1) / r.D;
+    float4 E[3], invD[3];
+    for(int k=0; k < 3; ++k) {
+        E[k] = float4::splat(r.E[k]);
+        invD[k] = float4::splat(inverse[k]);
+    }
+
+    struct Entry { int node; float t; } stack[StackSize];
+    int top = 0;
+    stack[top].node = 0;
+    stack[top++].t = r.near;
+    while (top > 0) {
+        Entry e = stack[--top];
+        if (e.t > r.far) continue;      // closer hit found since it was pushed
+        const Node &node = nodes[e.node];
+        float t[4];
+        int mask = hitChildren(node, E, invD, r.near, r.far, t);
+
+        // children hit, sorted by entry distance
+        Entry hits[4];
+        int count = 0;
+        for(int c=0; c < 4; ++c) {
+            if (!(mask & (1 << c))) continue;
+            int h = count++;
+            for(; h > 0 && hits[h-1].t > t[c]; --h)
+                hits[h] = hits[h-1];
+            hits[h].node = node.child[c];
+            hits[h].t = t[c];
+        }
+
+        for(int h = count-1; h >= 0; --h)
+            if (hits[h].node >= 0)
+                stack[top++] = hits[h];
+        for(int h=0; h < count; ++h) {
+            if (hits[h].node >= 0 || hits[h].t > r.far) continue;
+            ++tests;
+            Intersection current = list[~hits[h].node]->intersect(r);
+            if (current < closest) {
+                closest = current;
+                r.far = closest.t;      // anything farther can't be the closest
+            }
+        }
+    }
+    return closest;
+}
+
+// true if r hits any of objects between r.near and r.far
+bool
+QBvh::probe(const std::vector<Object*> &list, const Ray &r, uint64_t &tests,
+            int *blocker) const
+{
+    if (nodes.empty()) return false;
+
+    Vec3 inverse = Vec3(1, 1, 1) / r.D;
+    float4 E[3], invD[3];
+    for(int k=0; k < 3; ++k) {
+        E[k] = float4::splat(r.E[k]);
+        invD[k] = float4::splat(inverse[k]);
+    }
+
+    int stack[StackSize];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node &node = nodes[stack[--top]];
+        float t[4];
+        int mask = hitChildren(node, E, invD, r.near, r.far, t);
+        for(int c=0; c < 4; ++c) {
+            if (!(mask & (1 << c))) continue;
+            if (node.child[c] >= 0)
+                stack[top++] = node.child[c];
+            else {
+                ++tests;
+                if (list[~node.child[c]]->intersect(r).t < r.far) {
+                    if (blocker) *blocker = ~node.child[c];
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// print size and build times
+void
+QBvh::stats(std::ostream &out) const
+{
+    double perObject = objects ? double(bytes()) / objects : 0;
+    double binaryPerObject = objects ? double(binaryBytes) / objects : 0;
+    out << "QBVH: " << objects << " objects, " << nodes.size() << " 4-wide nodes, "
+        << bytes() / 1024 << " KB, " << perObject << " bytes/object (linear BVH "
+        << binaryPerObject << ")\n"
+        << "  build " << 1000 * (binaryTime + collapseTime) << " ms (linear BVH "
+        << 1000 * binaryTime << ", collapse " << 1000 * collapseTime << ")\n";
+}
@@ -0,0 +1,110 @@
+// compressed 4-wide bounding volume hierarchy over a list of objects
+#ifndef QBVH_HPP
+#define QBVH_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Intersection.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <ostream>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// classes we only use by pointer or reference
+class Object;
+class Ray;
+class ThreadPool;
+
+// BVH with four children per node and 8-bit child bounds
+// built by collapsing a linear BVH: each node takes the two children of a
+// binary node and keeps opening its largest internal child until it has
+// four; child bounds are stored as 0-255 steps of a power-of-two scale from
+// the node's own corner, rounded outward, so a node is 64 bytes, the size
+// of a cache line, and nodes are allocated on cache line boundaries so
+// each is fetched in one; the ray is tested against all four children at once
+class QBvh {
+private: // private types
+    // allocator for vectors whose elements start on Bytes boundaries, as
+    // std::allocator only promises the alignment of the largest basic type
+    template<class T, size_t Bytes>
+    struct Aligned {
+        typedef T value_type;
+        template<class U> struct rebind { typedef Aligned<U, Bytes> other; };
+
+        Aligned() {}
+        template<class U> Aligned(const Aligned<U, Bytes> &) {}
+
+        T *allocate(size_t n) {
+            void *p = 0;
+#ifdef _WIN32
+            p = _aligned_malloc(n * sizeof(T), Bytes);
+#else
+            if (posix_memalign(&p, Bytes, n * sizeof(T)) != 0) p = 0;
+#endif
+            if (!p) throw std::bad_alloc();
+            return static_cast<T*>(p);
+        }
+        void deallocate(T *p, size_t) {
+#ifdef _WIN32
+            _aligned_free(p);
+#else
+            free(p);
+#endif
+        }
+
+        template<class U> bool operator==(const Aligned<U, Bytes> &) const { return true; }
+        template<class U> bool operator!=(const Aligned<U, Bytes> &) const { return false; }
+    };
+
+private: // private data
+    struct alignas(64) Node {
+        float origin[3];        // low corner of the node bounds
+        float scale[3];         // power of two step for each axis
+        uint8_t lo[3][4];       // child bounds, per axis then child
+        uint8_t hi[3][4];
+        int child[4];           // node index, ~object, or Empty
+    };
+    std::vector<Node, Aligned<Node, 64> > nodes;   // root is nodes[0]
+    int objects;                // objects in the tree
+
+    // build statistics
+    double binaryTime, collapseTime;
+    size_t binaryBytes;         // of the linear BVH it was collapsed from
+
+public: // constructors
+    QBvh() : objects(0), binaryTime(0), collapseTime(0), binaryBytes(0) {}
+
+public: // manipulators
+    // rebuild for objects, using pool's threads if given
+    // treelets is the number of treelet passes for the linear BVH
+    void build(const std::vector<Object*> &objects, int treelets, ThreadPool *pool);
+
+public: // computational members
+    // closest intersection of r with objects, or none
+    // adds the number of objects tested to tests
+    const Intersection trace(const std::vector<Object*> &objects, Ray r,
+                             uint64_t &tests) const;
+
+    // true if r hits any of objects between r.near and r.far
+    // if blocker is given, it's set to the number of the object hit
+    bool probe(const std::vector<Object*> &objects, const Ray &r, uint64_t &tests,
+               int *blocker=0) const;
+
+    // bytes used by the tree
+    size_t bytes() const { return nodes.size() * sizeof(Node); }
+
+    // print node count, size per object against the linear BVH, and times
+    void stats(std::ostream &out) const;
+
+private: // internal helpers
+    // entry distances into the children of node, and a bit for each hit
+    int hitChildren(const Node &node, const float4 E[3], const float4 invD[3],
+                    float near, float far, float t[4]) const;
+};
+
+#endif
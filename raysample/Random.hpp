@@ -0,0 +1,51 @@
+// small, fast random numbers for stochastic sampling
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+// system includes necessary for the interface
+#include <stdint.h>
+
+// PCG32 generator: 64-bit state, 32-bit output
+// seeded per pixel so stochastic renders are repeatable regardless of
+// which thread gets which pixel
+class Random {
+private: // private data
+    uint64_t state;         // generator state
+    uint64_t inc;           // stream selector, must be odd
+
+public: // constructors
+    Random(uint64_t _seed=0, uint64_t _stream=0) { seed(_seed, _stream); }
+
+public: // manipulators
+    // restart sequence for this seed and stream
+    void seed(uint64_t _seed, uint64_t _stream=0) {
+        state = 0;
+        inc = (_stream << 1) | 1;
+        next();
+        state += _seed;
+        next();
+    }
+
+public: // computational members
+    // next 32-bit random number
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rot = uint32_t(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+
+    // uniform float in [0,1)
+    float uniform() {
+        return float(next() >> 8) * (1.f / 16777216.f);
+    }
+
+    // generator for the calling thread
+    static Random &local() {
+        static thread_local Random rng;
+        return rng;
+    }
+};
+
+#endif
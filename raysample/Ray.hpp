@@ -15,6 +15,7 @@ public: // public data
     float far;          // farthest t to count as intersection
     int bounces;        // number of bounces allowed for ray
     float influence;    // maximum contribution of this ray to the final image
+    float cutoff;       // don't spawn rays with influence at or below this
 
     // derived, for intersection testing
     float D_dot_D;
@@ -22,7 +23,7 @@ public: // public data
 public: // constructors
     Ray(const Vec3 _start, const Vec3 _direction, 
         float _near=1e-4, float _far=INFINITY,
-        int _bounces=0, float _influence=0) 
+        int _bounces=0, float _influence=0, float _cutoff=0) 
     {
         E = _start;
         D = _direction;
@@ -33,6 +34,7 @@ public: // constructors
 
         bounces = _bounces;
         influence = _influence;
+        cutoff = _cutoff;
     }
 };
 
@@ -0,0 +1,242 @@
+// implementation code for Sampler class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Sampler.hpp"
+
+// other classes used directly in the implementation
+#include "World.hpp"
+#include "Object.hpp"
+#include "Random.hpp"
+#include "ShadeBatch.hpp"
+#include "ShadeCache.hpp"
+#include "TemporalCache.hpp"
+
+// system includes
+#include <atomic>
+#include <vector>
+
+static std::atomic<long long> PixelCount(0), SampleCount(0);
+
+// color for pixel i,j
+const Vec3
+Sampler::pixel(int i, int j) const
+{
+    return pixel(i, j, Quality(world));
+}
+
+// color for pixel i,j with quality in place of the world's settings
+const Vec3
+Sampler::pixel(int i, int j, const Quality &quality) const
+{
+    seed(i, j);
+    Random &rng = Random::local();
+    ++PixelCount;
+
+    // position of sub-pixel sx,sy
+    int n = quality.samples;
+    auto position = [&](int s, int sub) {
+        float offset = world.jitter ? rng.uniform() : 0.5f;
+        return (s + (sub + offset)/n);
+    };
+
+    if (n == 1) {
+        ++SampleCount;
+        float x = position(i, 0), y = position(j, 0);
+        return sample(x, y, quality);
+    }
+
+    // corner sub-pixels first
+    Vec3 sum, lo(INFINITY, INFINITY, INFINITY), hi(-INFINITY, -INFINITY, -INFINITY);
+    const int corner[4][2] = {{0,0}, {n-1,0}, {0,n-1}, {n-1,n-1}};
+    for(int c=0; c < 4; ++c) {
+        Vec3 col = sample(position(i, corner[c][0]), position(j, corner[c][1]), quality);
+        sum = sum + col;
+        lo = min(lo, col);
+        hi = max(hi, col);
+    }
+    SampleCount += 4;
+
+    // contrast (hi-lo)/(hi+lo) in any channel over the threshold?
+    bool refine = false;
+    for(int k=0; k < 3; ++k)
+        if (hi[k] - lo[k] > World::contrast * (hi[k] + lo[k]))
+            refine = true;
+    if (!refine || n == 2)
+        return sum / 4;
+
+    // fill in the rest of the grid
+    for(int sy=0; sy < n; ++sy) {
+        for(int sx=0; sx < n; ++sx) {
+            if ((sx == 0 || sx == n-1) && (sy == 0 || sy == n-1))
+                continue;
+            sum = sum + sample(position(i, sx), position(j, sy), quality);
+        }
+    }
+    SampleCount += n*n - 4;
+    return sum / float(n*n);
+}
+
+// colors for a block of pixels
+// the thread's random numbers are seeded and drawn from for each pixel
+// both before its ray is traced and again before it is shaded, so they
+// are the same as for pixel at every step
+void
+Sampler::block(int x0, int y0, int x1, int y1, const Quality &quality, int group,
+               bool batch, Vec3 *colors) const
+{
+    int samples = World::roulette > 0 || World::lightSamples > 0
+        ? World::pixelSamples : 1;
+    if (quality.samples > 1 || samples > 1 || group < 2) {
+        for(int j=y0; j < y1; ++j)
+            for(int i=x0; i < x1; ++i)
+                *colors++ = pixel(i, j, quality);
+        return;
+    }
+
+    Random &rng = Random::local();
+    int width = x1 - x0, count = width * (y1 - y0);
+    auto ray = [&](int k) {
+        int i = x0 + k % width, j = y0 + k / width;
+        seed(i, j);
+        float x = i + (world.jitter ? rng.uniform() : 0.5f);
+        float y = j + (world.jitter ? rng.uniform() : 0.5f);
+        Ray r = world.primary(view, x, y);
+        r.bounces = quality.maxdepth;
+        r.cutoff = quality.cutoff;
+        return r;
+    };
+
+    std::vector<Ray> rays;
+    for(int k=0; k < count; ++k)
+        rays.push_back(ray(k));
+    std::vector<Intersection> hits(count);
+    std::vector<HitRecord> records(count);
+    world.objects.traceGroup(rays.data(), hits.data(), records.data(), count, group);
+    if (!batch || !ShadeBatch::usable(world)) {
+        for(int k=0; k < count; ++k) {
+            ray(k);
+            colors[k] = hits[k].color(world, rays[k], records[k]);
+        }
+    }
+    else {
+        // a few batches open at once, so hits on surfaces that alternate
+        // still fill them; when none will take a hit, the fullest is shaded
+        // to make room
+        const int Open = 4;
+        std::vector<ShadeBatch> batches(Open, ShadeBatch(world));
+        for(int k=0; k < count; ++k) {
+            const Object *obj = hits[k].object();
+            if (!obj) {
+                colors[k] = world.background;
+                continue;
+            }
+            const Object *shader = obj->shader(hits[k].part);
+            int use = -1, fullest = 0;
+            for(int b=0; b < Open && use < 0; ++b)
+                if (!batches[b].empty() && batches[b].accepts(shader))
+                    use = b;
+            for(int b=0; b < Open && use < 0; ++b)
+                if (batches[b].empty())
+                    use = b;
+            for(int b=1; b < Open && use < 0; ++b)
+                if (batches[b].size() > batches[fullest].size())
+                    fullest = b;
+            if (use < 0) {
+                batches[fullest].shade(colors);
+                use = fullest;
+            }
+
+            ray(k);
+            batches[use].add(k, shader, rays[k], records[k]);
+            if (batches[use].full())
+                batches[use].shade(colors);
+        }
+        for(auto &b : batches)
+            if (!b.empty())
+                b.shade(colors);
+    }
+    PixelCount += count;
+    SampleCount += count;
+}
+
+// color for pixel i,j, recording its hits
+const Vec3
+Sampler::record(int i, int j, const Quality &quality, int limit, ShadePath &path) const
+{
+    seed(i, j);
+    Random &rng = Random::local();
+    ++PixelCount;
+    ++SampleCount;
+
+    float x = i + (world.jitter ? rng.uniform() : 0.5f);
+    float y = j + (world.jitter ? rng.uniform() : 0.5f);
+    Ray ray = world.primary(view, x, y);
+    ray.bounces = quality.maxdepth;
+    ray.cutoff = quality.cutoff;
+    path.start(ray.bounces, limit, int(world.lights.size()));
+    HitRecord hit;
+    Intersection isect = world.objects.trace(ray, &hit);
+    return isect.color(world, ray, hit, &path);
+}
+
+// color for pixel i,j, reusing its shadows
+const Vec3
+Sampler::reproject(int i, int j, const Quality &quality, TemporalCache &cache) const
+{
+    seed(i, j);
+    Random &rng = Random::local();
+    ++PixelCount;
+    ++SampleCount;
+
+    float x = i + (world.jitter ? rng.uniform() : 0.5f);
+    float y = j + (world.jitter ? rng.uniform() : 0.5f);
+    Ray ray = world.primary(view, x, y);
+    ray.bounces = quality.maxdepth;
+    ray.cutoff = quality.cutoff;
+    HitRecord hit;
+    Intersection isect = world.objects.trace(ray, &hit);
+    const Object *obj = isect.object();
+    bool reused = cache.reuse(i, j, obj ? obj->id : -1, isect.part, hit.P);
+    if (!obj)
+        return world.background;
+
+    uint64_t before = ObjectList::threadShadows();
+    Vec3 col = obj->shader(isect.part)->color(world, ray, hit, 0, cache.shadowsAt(i, j), reused);
+    cache.count(ObjectList::threadShadows() - before);
+    return col;
+}
+
+// seed per pixel so results don't depend on thread timing
+void
+Sampler::seed(int i, int j) const
+{
+    Random::local().seed(uint64_t(j)*world.width + i);
+}
+
+// color for image position x,y
+const Vec3
+Sampler::sample(float x, float y, const Quality &quality) const
+{
+    // roulette and light sampling are stochastic, so average several samples
+    int samples = World::roulette > 0 || World::lightSamples > 0
+        ? World::pixelSamples : 1;
+
+    Vec3 col;
+    for(int s=0; s < samples; ++s) {
+        Ray ray = world.primary(view, x, y);
+        ray.bounces = quality.maxdepth;
+        ray.cutoff = quality.cutoff;
+        HitRecord hit;
+        Intersection isect = world.objects.trace(ray, &hit);
+        col = col + isect.color(world, ray, hit);
+    }
+    return col / float(samples);
+}
+
+// average anti-aliasing samples per pixel so far
+float
+Sampler::samplesPerPixel()
+{
+    return PixelCount ? float(SampleCount) / float(PixelCount) : 0.f;
+}
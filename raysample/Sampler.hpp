@@ -0,0 +1,77 @@
+// per-pixel sampling: adaptive anti-aliasing and averaging of stochastic modes
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Vec3.hpp"
+#include "World.hpp"
+
+// classes we only use by pointer or reference
+class ShadePath;
+class TemporalCache;
+
+// ray tree limits and anti-aliasing for a pixel, normally the world's
+struct Quality {
+    int maxdepth;                   // reflection and refraction bounces
+    float cutoff;                   // minimum influence of a secondary ray
+    int samples;                    // up to samples x samples rays per pixel
+
+    Quality() : maxdepth(0), cutoff(0), samples(1) {}
+    Quality(int _maxdepth, float _cutoff, int _samples)
+        : maxdepth(_maxdepth), cutoff(_cutoff), samples(_samples) {}
+    explicit Quality(const World &world)
+        : maxdepth(world.maxdepth), cutoff(world.cutoff), samples(world.samples) {}
+};
+
+class Sampler {
+private: // private data
+    const World &world;
+    View view;                      // camera the rays start from
+
+public: // constructors
+    // sample world through cam
+    Sampler(const World &_world, const Camera &cam) : world(_world), view(cam) {}
+    Sampler(const World &_world) : world(_world), view(_world.camera) {}
+
+public: // computational members
+    // color for pixel i,j
+    // starts with the corner sub-pixels of the world's samples x samples
+    // grid, and traces the rest only if those exceed World::contrast
+    const Vec3 pixel(int i, int j) const;
+
+    // color for pixel i,j with quality in place of the world's settings
+    const Vec3 pixel(int i, int j, const Quality &quality) const;
+
+    // colors for pixels x0,y0 to x1-1,y1-1, row by row, the same as pixel
+    // gives; when each pixel takes just one ray, their primary rays are
+    // traced group at a time with interleaved traversal, and if batch is
+    // set and every light is shaded, their hits are shaded in ShadeBatches
+    // of the same surface, the same but for the last bits of specular
+    void block(int x0, int y0, int x1, int y1, const Quality &quality, int group,
+               bool batch, Vec3 *colors) const;
+
+    // color for pixel i,j from its one ray, recording its hits on path up
+    // to limit bounces deep; only for one ray per pixel, with no
+    // stochastic modes
+    const Vec3 record(int i, int j, const Quality &quality, int limit,
+                      ShadePath &path) const;
+
+    // color for pixel i,j from its one ray, with its primary hit's light
+    // visibilities reused from the last frame in cache if they match, or
+    // traced and kept there for the next; only for one ray per pixel,
+    // with no stochastic light selection
+    const Vec3 reproject(int i, int j, const Quality &quality, TemporalCache &cache) const;
+
+    // average anti-aliasing samples per pixel so far
+    static float samplesPerPixel();
+
+private: // internal helpers
+    // seed the thread's random numbers for pixel i,j
+    void seed(int i, int j) const;
+
+    // color for image position x,y, averaged over World::pixelSamples if
+    // any stochastic mode is on
+    const Vec3 sample(float x, float y, const Quality &quality) const;
+};
+
+#endif
@@ -0,0 +1,176 @@
+// implementation code for ShadeBatch class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "ShadeBatch.hpp"
+
+// other classes used directly in the implementation
+#include "Intersection.hpp"
+#include "Object.hpp"
+#include "Ray.hpp"
+#include "World.hpp"
+#include "float8.hpp"
+
+// system includes
+#include <algorithm>
+
+// empty batch
+ShadeBatch::ShadeBatch(const World &_world)
+    : world(_world), surface(0), count(0)
+{}
+
+// the parameters the lanes share; reflection and refraction are traced
+// with each hit's own
+bool
+ShadeBatch::accepts(const Object *shader) const
+{
+    if (!surface) return true;
+    const Surface &s = shader->appearance();
+    for(int c=0; c < 3; ++c)
+        if (s.ambient[c] != surface->ambient[c] || s.diffuse[c] != surface->diffuse[c] ||
+            s.specular[c] != surface->specular[c])
+            return false;
+    return s.e == surface->e;
+}
+
+// keep the thread's random numbers as the hit would start shading with them
+void
+ShadeBatch::add(int _index, const Object *shader, const Ray &r, const HitRecord &hit)
+{
+    if (!surface)
+        surface = &shader->appearance();
+    index[count] = _index;
+    objects[count] = shader;
+    rays[count] = &r;
+    hits[count] = &hit;
+    rng[count] = Random::local();
+    ++count;
+}
+
+// Object::color, a light at a time for every hit, with each step in the
+// same order so the sums round the same
+void
+ShadeBatch::shade(Vec3 *colors)
+{
+    Random &local = Random::local();
+    const Surface &s = *surface;
+    const float8 zero;
+
+    // points, normals, and view vectors in lanes; lanes past count are
+    // zero, and never stored
+    float lanes[9][Width] = {};
+    for(int k=0; k < count; ++k) {
+        Vec3 V = -normalize(rays[k]->D);
+        for(int a=0; a < 3; ++a) {
+            lanes[a][k] = hits[k]->P[a];
+            lanes[3 + a][k] = hits[k]->N[a];
+            lanes[6 + a][k] = V[a];
+        }
+    }
+    float8 P[3], N[3], V[3];
+    for(int a=0; a < 3; ++a) {
+        P[a] = float8::load(lanes[a]);
+        N[a] = float8::load(lanes[3 + a]);
+        V[a] = float8::load(lanes[6 + a]);
+    }
+    int live = (1 << count) - 1;
+
+    // base color
+    float8 col[3];
+    if (World::effects & World::AMBIENT)
+        for(int c=0; c < 3; ++c)
+            col[c] = float8::splat(s.ambient[c]);
+
+    bool specular = (World::effects & World::SPECULAR) &&
+        s.specular[0] + s.specular[1] + s.specular[2] > 0.f;
+
+    for(size_t l=0; l < world.lights.size(); ++l) {
+        const Light &li = world.lights[l];
+
+        // light vectors
+        float8 L[3];
+        for(int a=0; a < 3; ++a)
+            L[a] = float8::splat(li.pos[a]) - P[a];
+        float8 LLen = sqrt(L[0]*L[0] + L[1]*L[1] + L[2]*L[2]);
+        float8 inverse = float8::splat(1) / LLen;
+        for(int a=0; a < 3; ++a)
+            L[a] = L[a] * inverse;
+
+        // hits facing the light
+        float8 N_dot_L = N[0]*L[0] + N[1]*L[1] + N[2]*L[2];
+        float8 facing = N_dot_L > zero;
+        int cast = bits(facing) & live;
+        if (!cast)
+            continue;
+
+        // gather the shadow rays toward this light
+        float visible[Width];
+        std::fill(visible, visible + Width, 1.f);
+        if (World::effects & World::SHADOW) {
+            float dir[3][Width], dist[Width];
+            for(int a=0; a < 3; ++a)
+                L[a].store(dir[a]);
+            LLen.store(dist);
+            for(int k=0; k < count; ++k) {
+                if (!(cast >> k & 1))
+                    continue;
+                const Vec3 &from = hits[k]->P;
+                if (li.type == Light::POINT) {
+                    Ray shadow(from, Vec3(dir[0][k], dir[1][k], dir[2][k]), 1e-4f, dist[k]);
+                    visible[k] = world.objects.probe(shadow) ? 0.f : 1.f;
+                }
+                else {
+                    local = rng[k];
+                    visible[k] = li.visibility(world.objects, from);
+                    rng[k] = local;
+                }
+            }
+        }
+        float8 shown = float8::load(visible);
+        float8 reached = select(facing, shown, zero) > zero;
+
+        // Blinn specular power with the normalized half vector
+        float8 power;
+        if (specular) {
+            float8 H[3];
+            for(int a=0; a < 3; ++a)
+                H[a] = V[a] + L[a];
+            float8 scale = rsqrt(H[0]*H[0] + H[1]*H[1] + H[2]*H[2]);
+            for(int a=0; a < 3; ++a)
+                H[a] = H[a] * scale;
+            float8 N_dot_H = N[0]*H[0] + N[1]*H[1] + N[2]*H[2];
+            power = select(N_dot_H > zero, pow(N_dot_H, float8::splat(s.e)), zero);
+        }
+
+        // this light's diffuse and specular, added where it reaches
+        for(int c=0; c < 3; ++c) {
+            float8 lcol = shown * float8::splat(li.col[c]);
+            float8 lightColor;
+            if (World::effects & World::DIFFUSE)
+                lightColor = lightColor + lcol * float8::splat(s.diffuse[c]) * N_dot_L;
+            if (specular)
+                lightColor = lightColor + lcol * float8::splat(s.specular[c]) * power;
+            col[c] = col[c] + select(reached, lightColor, zero);
+        }
+    }
+
+    // reflection and refraction, a hit at a time with its own random numbers
+    float direct[3][Width];
+    for(int c=0; c < 3; ++c)
+        col[c].store(direct[c]);
+    for(int k=0; k < count; ++k) {
+        local = rng[k];
+        Vec3 base(direct[0][k], direct[1][k], direct[2][k]);
+        colors[index[k]] = objects[k]->secondary(world, *rays[k], *hits[k], base);
+    }
+
+    surface = 0;
+    count = 0;
+}
+
+// Object::color picks lights at random when there are more than it samples
+bool
+ShadeBatch::usable(const World &world)
+{
+    return !(World::lightSamples > 0 && world.lights.size() > size_t(World::lightSamples));
+}
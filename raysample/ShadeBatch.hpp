@@ -0,0 +1,69 @@
+// primary hits sharing a surface, shaded several at a time in vector lanes
+#ifndef SHADEBATCH_HPP
+#define SHADEBATCH_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Random.hpp"
+#include "Vec3.hpp"
+
+// classes we only use by pointer or reference
+class World;
+class Object;
+class Ray;
+struct HitRecord;
+struct Surface;
+
+// up to Width hits on objects with the same surface parameters, shaded
+// together: each light's N.L, Blinn half vector, specular power, and the
+// ambient, diffuse, and specular sums are computed for all the hits at once
+// in float8 lanes, and the batch's shadow rays toward each light are
+// gathered and probed back to back, while that light's part of the scene
+// is in the cache; reflection and refraction are then traced hit by hit
+// each hit keeps its own random numbers, so area light and roulette samples
+// are the same as when it's shaded alone, and sums are taken in the same
+// order, so colors match Object::color but for float8's pow, which can
+// differ from the C library's in the last few bits
+class ShadeBatch {
+public: // public types
+    static const int Width = 8;
+
+private: // private data
+    const World &world;
+    const Surface *surface;         // of the first hit, shared by the rest
+    int count;
+
+    // for each hit: where its color goes, its object, ray, and hit record,
+    // and the thread's random numbers when it was added
+    int index[Width];
+    const Object *objects[Width];
+    const Ray *rays[Width];
+    const HitRecord *hits[Width];
+    Random rng[Width];
+
+public: // constructors
+    // empty batch for hits in world
+    explicit ShadeBatch(const World &world);
+
+public: // manipulators
+    // add the hit of ray r on shader, which must be accepted, to be shaded
+    // into colors[index]; r and hit must last until the batch is shaded
+    void add(int index, const Object *shader, const Ray &r, const HitRecord &hit);
+
+    // shade every hit into the colors array, and empty the batch
+    void shade(Vec3 *colors);
+
+public: // computational members
+    // whether shader's hits can join: the batch is empty, or its surface has
+    // the same parameters
+    bool accepts(const Object *shader) const;
+
+    bool empty() const { return count == 0; }
+    bool full() const { return count == Width; }
+    int size() const { return count; }
+
+    // whether world's hits can be batched: every light is shaded, rather
+    // than a stochastic selection of them
+    static bool usable(const World &world);
+};
+
+#endif
@@ -0,0 +1,272 @@
+// implementation code for ShadePath and ShadeCache classes
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "ShadeCache.hpp"
+
+// other classes used directly in the implementation
+#include "Checkpoint.hpp"
+#include "Object.hpp"
+#include "Ray.hpp"
+#include "World.hpp"
+
+// system includes
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+// don't complain about MS-deprecated standard C functions
+#pragma warning( disable: 4996 )
+#endif
+
+// file identification, changed if the layout changes
+static const char Magic[8] = { 'r','s','h','a','d','e','1','\n' };
+
+// 4-byte words of a hit in the file
+static const int HitWords = 14;
+
+// start recording
+void
+ShadePath::start(int bounces, int _limit, int _lights)
+{
+    hits.clear();
+    visibility.clear();
+    complete = true;
+    replay = false;
+    first = bounces;
+    limit = _limit;
+    lights = _lights;
+    cursor = -1;
+}
+
+// record a hit, unless it's past the bounce limit
+bool
+ShadePath::add(int object, int part, const Ray &ray, const HitRecord &hit)
+{
+    if (first - ray.bounces > limit) {
+        complete = false;
+        return false;
+    }
+
+    Hit h;
+    h.object = object;
+    h.part = part;
+    h.P = hit.P;
+    h.N = hit.N;
+    h.D = ray.D;
+    h.reflect = h.refract = -1;
+    h.visibility = int(visibility.size());
+    visibility.resize(visibility.size() + lights, 1.f);
+    cursor = int(hits.size());
+    hits.push_back(h);
+    return true;
+}
+
+// shade hit h and the hits of its secondary rays from the record
+const Vec3
+ShadePath::color(const World &world, int h)
+{
+    replay = true;
+    const Hit &hit = hits[h];
+    if (hit.object < 0)
+        return world.background;
+
+    HitRecord record;
+    record.P = hit.P;
+    record.N = hit.N;
+    record.prim = hit.object;
+    record.u = record.v = 0;
+    cursor = h;
+    const Object *obj = world.objects.objects[hit.object]->shader(hit.part);
+    return obj->color(world, Ray(hit.P - hit.D, hit.D), record, this);
+}
+
+// empty cache
+ShadeCache::ShadeCache(const std::string &_filename, uint64_t _hash, const Tile &_region,
+                       int _bounces, size_t _limit)
+    : filename(_filename), hash(_hash), region(_region), bounces(_bounces), limit(_limit),
+      paths(size_t(_region.width()) * _region.height()), loaded(false),
+      used(0), kept(0), deep(0), full(0)
+{}
+
+// keep a recorded path if it's complete and fits
+void
+ShadeCache::finish(ShadePath &path)
+{
+    if (!path.complete) {
+        ++deep;
+        path = ShadePath();
+        return;
+    }
+    path.hits.shrink_to_fit();
+    path.visibility.shrink_to_fit();
+    size_t size = path.bytes();
+    if (used.fetch_add(size) + size > limit) {
+        used -= size;
+        ++full;
+        path = ShadePath();
+        return;
+    }
+    ++kept;
+}
+
+// read paths from the file
+bool
+ShadeCache::load()
+{
+    FILE *in = fopen(filename.c_str(), "rb");
+    if (!in) return false;
+
+    char magic[sizeof(Magic)];
+    uint64_t fileHash;
+    int32_t r[4];
+    bool ok = fread(magic, sizeof(magic), 1, in) == 1 && memcmp(magic, Magic, sizeof(Magic)) == 0
+        && fread(&fileHash, sizeof(fileHash), 1, in) == 1 && fileHash == hash
+        && fread(r, sizeof(r), 1, in) == 1
+        && r[0] == region.x0 && r[1] == region.y0 && r[2] == region.x1 && r[3] == region.y1;
+
+    // per pixel: hit count, 0 if not kept, visibility count, then the hits
+    // and visibilities
+    std::vector<uint32_t> words;
+    for(size_t p=0; ok && p < paths.size(); ++p) {
+        ShadePath &path = paths[p];
+        uint32_t counts[2];
+        ok = fread(counts, sizeof(counts), 1, in) == 1;
+        if (!ok || counts[0] == 0) continue;
+
+        words.resize(counts[0] * HitWords);
+        path.hits.resize(counts[0]);
+        path.visibility.resize(counts[1]);
+        ok = fread(words.data(), sizeof(uint32_t), words.size(), in) == words.size()
+            && fread(path.visibility.data(), sizeof(float), counts[1], in) == counts[1];
+        for(uint32_t h=0; ok && h < counts[0]; ++h) {
+            const uint32_t *w = &words[h * HitWords];
+            float f[9];
+            memcpy(f, w + 2, sizeof(f));
+            ShadePath::Hit &hit = path.hits[h];
+            hit.object = int32_t(w[0]);
+            hit.part = int32_t(w[1]);
+            hit.P = Vec3(f[0], f[1], f[2]);
+            hit.N = Vec3(f[3], f[4], f[5]);
+            hit.D = Vec3(f[6], f[7], f[8]);
+            hit.reflect = int32_t(w[11]);
+            hit.refract = int32_t(w[12]);
+            hit.visibility = int32_t(w[13]);
+        }
+        path.complete = ok;
+        if (ok && used + path.bytes() > limit) {
+            path = ShadePath();
+            ++full;
+        }
+        else if (ok) {
+            used += path.bytes();
+            ++kept;
+        }
+    }
+    fclose(in);
+
+    if (!ok) {
+        paths.assign(paths.size(), ShadePath());
+        used = 0;
+        kept = full = 0;
+        return false;
+    }
+    loaded = true;
+    return true;
+}
+
+// write the paths to a temporary file, then rename it over the cache
+bool
+ShadeCache::save() const
+{
+    std::string temp = filename + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if (!out) return false;
+
+    int32_t r[4] = { region.x0, region.y0, region.x1, region.y1 };
+    fwrite(Magic, sizeof(Magic), 1, out);
+    fwrite(&hash, sizeof(hash), 1, out);
+    fwrite(r, sizeof(r), 1, out);
+    std::vector<uint32_t> words;
+    for(auto &path : paths) {
+        uint32_t counts[2] = { uint32_t(path.complete ? path.hits.size() : 0),
+                               uint32_t(path.complete ? path.visibility.size() : 0) };
+        fwrite(counts, sizeof(counts), 1, out);
+        if (counts[0] == 0) continue;
+
+        words.resize(path.hits.size() * HitWords);
+        for(size_t h=0; h < path.hits.size(); ++h) {
+            const ShadePath::Hit &hit = path.hits[h];
+            uint32_t *w = &words[h * HitWords];
+            float f[9] = { hit.P[0], hit.P[1], hit.P[2], hit.N[0], hit.N[1], hit.N[2],
+                           hit.D[0], hit.D[1], hit.D[2] };
+            w[0] = uint32_t(hit.object);
+            w[1] = uint32_t(hit.part);
+            memcpy(w + 2, f, sizeof(f));
+            w[11] = uint32_t(hit.reflect);
+            w[12] = uint32_t(hit.refract);
+            w[13] = uint32_t(hit.visibility);
+        }
+        fwrite(words.data(), sizeof(uint32_t), words.size(), out);
+        fwrite(path.visibility.data(), sizeof(float), path.visibility.size(), out);
+    }
+    bool ok = fflush(out) == 0 && !ferror(out);
+    fclose(out);
+#ifdef _WIN32
+    ::remove(filename.c_str());      // Windows rename won't replace a file
+#endif
+    if (!ok || rename(temp.c_str(), filename.c_str()) != 0) {
+        ::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// paths kept, and why the rest weren't
+void
+ShadeCache::stats(std::ostream &out) const
+{
+    out << (loaded ? "Shaded " : "Recorded ") << kept << " of " << paths.size()
+        << " pixels " << (loaded ? "from " : "in ") << filename << ", "
+        << used / (1024*1024.) << " MB of " << limit / (1024*1024.) << " MB";
+    if (deep > 0)
+        out << "; " << deep << " deeper than " << bounces << " bounce"
+            << (bounces == 1 ? "" : "s");
+    if (full > 0)
+        out << "; " << full << " past the memory limit";
+    if (loaded && kept < int(paths.size()))
+        out << "; " << paths.size() - kept << " traced";
+    out << '\n';
+}
+
+// hash of the scene's words, skipping the values after words that only
+// set colors
+uint64_t
+ShadeCache::sceneHash(const std::string &text)
+{
+    uint64_t h = Checkpoint::fnv(0, 0);
+    int skip = 0;
+    for(size_t end = 0; ; ) {
+        size_t start = text.find_first_not_of(" \t\r\n", end);
+        if (start == std::string::npos) break;
+        end = std::min(text.find_first_of(" \t\r\n", start), text.size());
+        if (skip > 0) {
+            --skip;
+            continue;
+        }
+
+        const char *word = text.data() + start;
+        size_t size = end - start;
+        h = Checkpoint::fnv(word, size, h);
+        h = Checkpoint::fnv(" ", 1, h);
+        auto is = [&](const char *name) {
+            return size == strlen(name) && memcmp(word, name, size) == 0;
+        };
+        if (is("ambient") || is("diffuse") || is("specular") || is("background"))
+            skip = 3;
+        else if (is("specpow") || is("light"))
+            skip = 1;       // a light's intensity comes before its position
+    }
+    return h;
+}
@@ -0,0 +1,127 @@
+// recorded hits and shadows, for shading again after surface or light color edits
+#ifndef SHADECACHE_HPP
+#define SHADECACHE_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Intersection.hpp"
+#include "Tiles.hpp"
+#include "Vec3.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <string>
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+
+// classes we only use by pointer or reference
+class World;
+class Ray;
+
+// hits along the rays of one pixel, recorded while shading it, so it can be
+// shaded again with new surface or light colors without tracing
+// Intersection::color adds each hit up to a bounce limit, and Object::color
+// fills in the shadow visibility of each light and the reflected and
+// refracted hits; shading from the path instead reads them back
+class ShadePath {
+public: // public types
+    struct Hit {
+        int object, part;           // object hit and part of it, or -1 for a miss
+        Vec3 P, N;                  // hit position and normal
+        Vec3 D;                     // ray direction
+        int reflect, refract;       // hits of the secondary rays, or -1
+        int visibility;             // of the first light, in visibility
+    };
+
+public: // public data
+    std::vector<Hit> hits;          // primary ray's hit first
+    std::vector<float> visibility;  // for each hit, one per light
+    bool complete;                  // every hit is recorded
+
+private: // private data
+    bool replay;                    // shading from the path rather than tracing
+    int first;                      // bounces left for the primary ray
+    int limit;                      // deepest bounce to record
+    int lights;
+    int cursor;                     // hit being shaded
+
+public: // constructors
+    ShadePath() : complete(false), replay(false), first(0), limit(0), lights(0), cursor(-1) {}
+
+public: // manipulators
+    // start recording from a primary ray with bounces left, up to limit
+    // bounces deep, for lights lights
+    void start(int bounces, int limit, int lights);
+
+    // record a hit on object's part, or a miss for -1, by ray
+    // returns false, and marks the path incomplete, if it's too deep
+    bool add(int object, int part, const Ray &ray, const HitRecord &hit);
+
+    // shade again from the recorded hits, starting from hit h
+    const Vec3 color(const World &world, int h=0);
+
+public: // computational members
+    // whether shading is reading the path rather than recording it
+    bool replaying() const { return replay; }
+
+    // hit being shaded, the latest added or the one color is at
+    int current() const { return cursor; }
+
+    // bytes the path takes
+    size_t bytes() const {
+        return sizeof(*this) + hits.capacity() * sizeof(Hit)
+            + visibility.capacity() * sizeof(float);
+    }
+};
+
+// a recorded path for each pixel of a region, saved to a file between
+// renders, keyed by a hash of the scene with its surface colors, specular
+// powers, and light intensities left out, and of the options
+// pixels too deep for the bounce limit, or past the memory limit, are left
+// out and traced as usual
+class ShadeCache {
+private: // private data
+    std::string filename;
+    uint64_t hash;
+    Tile region;
+    int bounces;                    // deepest bounce recorded
+    size_t limit;                   // most bytes of paths to keep
+    std::vector<ShadePath> paths;   // region's pixels, row by row
+    bool loaded;                    // paths came from the file
+
+    std::atomic<size_t> used;       // bytes of paths kept
+    std::atomic<int> kept, deep, full;  // paths kept, too deep, past the limit
+
+public: // constructors
+    // cache for region, in filename
+    ShadeCache(const std::string &filename, uint64_t hash, const Tile &region,
+               int bounces, size_t limit);
+
+public: // manipulators
+    // read the file, returning true if it's for the same scene and options,
+    // so the paths can be shaded again
+    bool load();
+
+    // write the paths recorded in this render, returning false if it can't
+    bool save() const;
+
+    // path for image pixel x,y, which must be in region
+    ShadePath &at(int x, int y) { return paths[(y - region.y0) * region.width() + x - region.x0]; }
+
+    // a path has been recorded: keep it if it's complete and fits
+    void finish(ShadePath &path);
+
+public: // computational members
+    // whether the paths were loaded to be shaded again
+    bool replaying() const { return loaded; }
+
+    // print paths kept and memory used
+    void stats(std::ostream &out) const;
+
+    // hash of scene file text without the values that only change shading:
+    // ambient, diffuse, and specular colors, specular powers, light
+    // intensities, and the background
+    static uint64_t sceneHash(const std::string &text);
+};
+
+#endif
@@ -7,6 +7,7 @@
 // other classes used directly in the implementation
 #include "World.hpp"
 #include "Ray.hpp"
+#include "Transform.hpp"
 
 Sphere::Sphere(const Surface &_surface, const Vec3 _center, float _radius)
     : Object(_surface) 
@@ -43,9 +44,30 @@ Sphere::intersect(const Ray &r) const
     return Intersection();              // sphere entirely behind start point
 }
 
-// appearance of sphere at position t on ray r
-const Vec3 Sphere::normal(const Vec3 P) const
+// position and normal at the closest hit
+// renormalize rather than scale by 1/R: t from the quadratic can leave P
+// noticeably off the surface of small, distant spheres
+void Sphere::hitRecord(const Ray &ray, const Intersection &isect, HitRecord &hit) const
 {
-    return normalize(P - C);
+    hit.P = fma(isect.t, ray.D, ray.E);
+    hit.N = normalize(hit.P - C);
+    hit.prim = id;
+    hit.u = hit.v = 0;
 }
 
+
+// center plus or minus the radius
+void Sphere::bounds(Vec3 &lo, Vec3 &hi) const
+{
+    lo = C - Vec3(R, R, R);
+    hi = C + Vec3(R, R, R);
+}
+
+// moved center, with the radius scaled by the transform's x axis, so
+// only uniform scales keep it exact
+void Sphere::move(const Transform &t)
+{
+    C = t.point(C);
+    R *= length(t.col[0]);
+    Rsquared = R*R;
+}
@@ -22,9 +22,16 @@ class Sphere : public Object {
 public: // constructors
     Sphere(const Surface &_surface, const Vec3 _center, float _radius);
 
+public: // accessors
+    const Vec3 &center() const { return C; }
+    float radius() const { return R; }
+
 public: // object functions
     const Intersection intersect(const Ray &ray) const override;
-    const Vec3 normal(const Vec3 P) const override;
+    void hitRecord(const Ray &ray, const Intersection &isect,
+                   HitRecord &hit) const override;
+    void bounds(Vec3 &lo, Vec3 &hi) const override;
+    void move(const Transform &t) override;
 };
 
 #endif
@@ -0,0 +1,110 @@
+// implementation code for TemporalCache class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "TemporalCache.hpp"
+
+// system includes
+#include <algorithm>
+#include <cmath>
+
+// empty cache, with nothing to reuse until the second frame
+TemporalCache::TemporalCache(const World &_world, const Tile &_region, float _tolerance)
+    : world(_world), region(_region), tolerance(_tolerance),
+      lights(int(_world.lights.size())), stride(lights + 1),
+      entries(size_t(_region.width()) * _region.height()), last(entries.size()),
+      shadows(entries.size() * stride), lastShadows(shadows.size()),
+      valid(false), filled(false), reused(0), traced(0), avoided(0)
+{}
+
+// this frame's hits become the last frame's
+void
+TemporalCache::frame(const View &_view, bool reuse)
+{
+    entries.swap(last);
+    shadows.swap(lastShadows);
+    lastView = view;
+    view = _view;
+    valid = reuse && filled;
+    filled = true;
+    reused = 0;
+    traced = avoided = 0;
+}
+
+// project P into the last frame's view, in the same way World::primary
+// makes rays, and compare it to the hit of the pixel it lands on
+bool
+TemporalCache::reuse(int x, int y, int object, int part, const Vec3 &P)
+{
+    size_t p = size_t(y - region.y0) * region.width() + x - region.x0;
+    Entry &entry = entries[p];
+    float *visibility = &shadows[p * stride];
+    entry.object = object;
+    entry.part = part;
+    entry.P = P;
+    std::fill(visibility, visibility + lights, 1.f);
+    visibility[lights] = 0;
+    if (object < 0)
+        return false;
+
+    // which pixel of the last frame P was in, if any
+    Vec3 d = P - lastView.eye;
+    float depth = -dot(d, lastView.w);
+    bool found = valid && depth > 0;
+    int px = 0, py = 0;
+    if (found) {
+        float us = dot(d, lastView.u) * lastView.dist / depth;
+        float vs = dot(d, lastView.v) * lastView.dist / depth;
+        float fx = (us - lastView.left) / (lastView.right - lastView.left) * world.width;
+        float fy = (vs - lastView.top) / (lastView.bottom - lastView.top) * world.height;
+        found = fx >= region.x0 && fx < region.x1 && fy >= region.y0 && fy < region.y1;
+        px = int(fx);
+        py = int(fy);
+    }
+    if (!found) return false;
+
+    // the same surface, close enough to the same point on it
+    size_t q = size_t(py - region.y0) * region.width() + px - region.x0;
+    const Entry &before = last[q];
+    if (before.object != object || before.part != part ||
+        length(before.P - P) > tolerance * length(P - view.eye))
+        return false;
+
+    // near a shadow edge, or a speck of self-shadowing, the visibility
+    // changes faster than the tolerance can tell, so only reuse it where
+    // the pixel's neighbors on the same object had the same
+    const float *seen = &lastShadows[q * stride];
+    const int around[4][2] = { {-1,0}, {1,0}, {0,-1}, {0,1} };
+    for(auto &offset : around) {
+        int nx = px + offset[0], ny = py + offset[1];
+        if (nx < region.x0 || nx >= region.x1 || ny < region.y0 || ny >= region.y1)
+            continue;
+        size_t n = size_t(ny - region.y0) * region.width() + nx - region.x0;
+        if (last[n].object == object && last[n].part == part &&
+            !std::equal(seen, seen + lights, &lastShadows[n * stride]))
+            return false;
+    }
+
+    entry.P = before.P;
+    std::copy(&lastShadows[q * stride], &lastShadows[q * stride] + stride, visibility);
+    ++reused;
+    avoided += uint64_t(visibility[lights]);
+    return true;
+}
+
+// shadow rays avoided, of all the frame's primary and secondary ones
+float
+TemporalCache::avoidedFraction() const
+{
+    uint64_t all = traced + avoided;
+    return all > 0 ? float(avoided) / float(all) : 0.f;
+}
+
+// pixels reused and shadow rays avoided
+void
+TemporalCache::stats(std::ostream &out) const
+{
+    out << "Reused shadows for " << reused << " of " << entries.size() << " pixels, "
+        << avoided << " shadow rays avoided, " << traced << " traced ("
+        << 100 * avoidedFraction() << "% avoided)\n";
+}
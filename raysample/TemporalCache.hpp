@@ -0,0 +1,82 @@
+// primary hits' shadows from the frame before, for reuse as the camera moves
+#ifndef TEMPORALCACHE_HPP
+#define TEMPORALCACHE_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Tiles.hpp"
+#include "Vec3.hpp"
+#include "World.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+
+// the primary hit of each pixel of a region, with the visibility of each
+// light from it, kept from one frame of a camera path to the next
+// a hit in the next frame is projected back into the last frame's view,
+// and if the pixel it lands on saw the same object within a tolerance of
+// the same point, that pixel's light visibilities are used in place of
+// shadow rays; ambient, diffuse, and specular are computed from them as
+// usual, and reflection and refraction are traced, so only the shadows
+// of the primary hit are reused
+// reused visibilities keep the point they were traced from, so however
+// many frames carry them, they're never farther from it than the tolerance
+class TemporalCache {
+private: // private types
+    struct Entry {
+        int object, part;           // object hit, or -1 for a miss
+        Vec3 P;                     // where the visibilities were traced from
+    };
+
+private: // private data
+    const World &world;
+    Tile region;
+    float tolerance;                // of the distance from the eye
+    int lights;
+    int stride;                     // floats per pixel: lights, then shadow rays
+
+    // this frame's and the last frame's, row by row, with their views
+    std::vector<Entry> entries, last;
+    std::vector<float> shadows, lastShadows;
+    View view, lastView;
+    bool valid;                     // the last frame's can be reused
+    bool filled;                    // a frame has been started
+
+    // this frame: pixels reused, and shadow rays traced and avoided
+    std::atomic<int> reused;
+    std::atomic<uint64_t> traced, avoided;
+
+public: // constructors
+    // cache for region of world's image, reusing hits within tolerance
+    // times their distance from the eye
+    TemporalCache(const World &world, const Tile &region, float tolerance);
+
+public: // manipulators
+    // start a frame seen through view; if reuse is false, as when objects
+    // have moved, nothing from the last frame is reused
+    void frame(const View &view, bool reuse);
+
+    // set pixel x,y's primary hit on object's part at P, or a miss for -1,
+    // returning true if the last frame's visibilities for it were copied
+    // to shadowsAt(x, y), or false if shading is to fill them in
+    bool reuse(int x, int y, int object, int part, const Vec3 &P);
+
+    // visibilities for pixel x,y this frame, which must be in region
+    float *shadowsAt(int x, int y) {
+        return &shadows[size_t((y - region.y0) * region.width() + x - region.x0) * stride];
+    }
+
+    // rays shadow rays were traced for a pixel this frame
+    void count(uint64_t rays) { traced += rays; }
+
+public: // computational members
+    // print pixels reused and the fraction of shadow rays avoided this frame
+    void stats(std::ostream &out) const;
+
+    // fraction of shadow rays avoided this frame
+    float avoidedFraction() const;
+};
+
+#endif
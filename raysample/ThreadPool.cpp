@@ -0,0 +1,180 @@
+// implementation code for ThreadPool class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "ThreadPool.hpp"
+
+// system includes
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// read one integer from a sysfs file, or -1 if not there
+static int
+readSysInt(const std::string &path)
+{
+    std::ifstream in(path);
+    int value = -1;
+    in >> value;
+    return in ? value : -1;
+}
+
+// cpus this process may run on, in the order threads should be pinned to them
+// empty if pinning isn't supported
+static std::vector<int>
+cpuOrder(ThreadPool::Affinity affinity)
+{
+    std::vector<int> order;
+#ifdef __linux__
+    if (affinity == ThreadPool::NONE) return order;
+
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return order;
+
+    struct Cpu { int cpu, package, core, sibling, coreRank; };
+    std::vector<Cpu> cpus;
+    for(int cpu=0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &set)) continue;
+        std::ostringstream topology;
+        topology << "/sys/devices/system/cpu/cpu" << cpu << "/topology/";
+        Cpu c = { cpu, readSysInt(topology.str() + "physical_package_id"),
+                  readSysInt(topology.str() + "core_id"), 0, 0 };
+        cpus.push_back(c);
+    }
+
+    // compact: socket by socket, core by core, hyperthread siblings adjacent
+    std::sort(cpus.begin(), cpus.end(), [](const Cpu &a, const Cpu &b) {
+        if (a.package != b.package) return a.package < b.package;
+        if (a.core != b.core) return a.core < b.core;
+        return a.cpu < b.cpu;
+    });
+
+    if (affinity == ThreadPool::SCATTER) {
+        // number each cpu's core within its socket, and each cpu within its core
+        for(size_t i=1; i < cpus.size(); ++i) {
+            const Cpu &p = cpus[i-1];
+            Cpu &c = cpus[i];
+            if (c.package != p.package) continue;
+            c.coreRank = p.coreRank + (c.core != p.core);
+            c.sibling = c.core == p.core ? p.sibling + 1 : 0;
+        }
+
+        // scatter: one thread per core, alternating sockets, before any siblings
+        std::stable_sort(cpus.begin(), cpus.end(), [](const Cpu &a, const Cpu &b) {
+            if (a.sibling != b.sibling) return a.sibling < b.sibling;
+            if (a.coreRank != b.coreRank) return a.coreRank < b.coreRank;
+            return a.package < b.package;
+        });
+    }
+
+    for(auto &c : cpus)
+        order.push_back(c.cpu);
+#endif
+    return order;
+}
+
+// start worker threads
+ThreadPool::ThreadPool(int threads, Affinity affinity, size_t _scratchBytes)
+    : scratchBytes(_scratchBytes), pinning(affinity), task(nullptr), count(0), next(0), busy(0),
+      generation(0), quit(false)
+{
+    if (threads < 1)
+        threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+    std::vector<int> cpus = cpuOrder(affinity);
+    scratchMem.resize(threads, nullptr);
+    for(int t=0; t < threads; ++t) {
+        int cpu = cpus.empty() ? -1 : cpus[t % cpus.size()];
+        workers.push_back(std::thread(&ThreadPool::worker, this, t, cpu));
+    }
+}
+
+// stop and join worker threads
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for(auto &w : workers)
+        w.join();
+    for(auto s : scratchMem)
+        free(s);
+}
+
+// run task for each index in [0,count)
+void
+ThreadPool::run(int _count, const Task &_task)
+{
+    if (_count <= 0) return;
+
+    std::unique_lock<std::mutex> guard(lock);
+    task = &_task;
+    count = _count;
+    next = 0;
+    busy = int(workers.size());
+    ++generation;
+    wake.notify_all();
+
+    done.wait(guard, [&]{ return busy == 0; });
+    task = nullptr;
+}
+
+// worker thread: pin, allocate scratch, then run tasks as they arrive
+void
+ThreadPool::worker(int thread, int cpu)
+{
+#ifdef __linux__
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+
+    // first touch from this thread places the pages on its NUMA node
+    if (scratchBytes) {
+        void *mem = malloc(scratchBytes);
+        memset(mem, 0, scratchBytes);
+        std::lock_guard<std::mutex> guard(lock);
+        scratchMem[thread] = mem;
+    }
+
+    unsigned seen = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    for(;;) {
+        wake.wait(guard, [&]{ return quit || generation != seen; });
+        if (quit) return;
+        seen = generation;
+        const Task &current = *task;
+        int items = count;
+        guard.unlock();
+
+        for(int i; (i = next++) < items; )
+            current(i, thread);
+
+        guard.lock();
+        if (--busy == 0)
+            done.notify_all();
+    }
+}
+
+// parse affinity name
+bool
+ThreadPool::parseAffinity(const char *name, Affinity &affinity)
+{
+    if (strcmp(name, "none") == 0)          affinity = NONE;
+    else if (strcmp(name, "compact") == 0)  affinity = COMPACT;
+    else if (strcmp(name, "scatter") == 0)  affinity = SCATTER;
+    else return false;
+    return true;
+}
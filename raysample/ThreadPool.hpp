@@ -0,0 +1,69 @@
+// persistent pool of worker threads
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+// system includes necessary for the interface
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+class ThreadPool {
+public: // public types
+    // where to pin worker threads
+    // COMPACT fills cores of one socket before moving to the next,
+    // SCATTER spreads threads across sockets and cores first
+    enum Affinity { NONE, COMPACT, SCATTER };
+
+    // task to run: index of work item and index of the thread running it
+    typedef std::function<void(int index, int thread)> Task;
+
+private: // private data
+    std::vector<std::thread> workers;
+    std::vector<void*> scratchMem;  // per-thread scratch, allocated by its thread
+    size_t scratchBytes;
+    Affinity pinning;               // how the workers were pinned
+
+    std::mutex lock;
+    std::condition_variable wake, done;
+    const Task *task;               // current task, null if none
+    int count;                      // work items in current task
+    std::atomic<int> next;          // next work item to hand out
+    int busy;                       // workers still working on current task
+    unsigned generation;            // incremented for each new task
+    bool quit;
+
+public: // constructor & destructor
+    // start threads workers, each with scratchBytes of its own scratch memory
+    ThreadPool(int threads, Affinity affinity=NONE, size_t scratchBytes=0);
+    ~ThreadPool();
+
+public: // computational members
+    // number of worker threads
+    int size() const { return int(workers.size()); }
+
+    // bytes of scratch memory per thread
+    size_t scratchSize() const { return scratchBytes; }
+
+    // where the worker threads were asked to be pinned
+    Affinity affinity() const { return pinning; }
+
+    // run task for each index in [0,count), returning once all are done
+    // items are handed out in index order to whichever thread is free
+    void run(int count, const Task &task);
+
+    // scratch memory for a worker thread
+    // allocated and first touched by that thread after it is pinned, so
+    // on NUMA systems it comes from memory local to the thread's node
+    void *scratch(int thread) const { return scratchMem[thread]; }
+
+    // parse "none", "compact", or "scatter", returning false if unknown
+    static bool parseAffinity(const char *name, Affinity &affinity);
+
+private: // internal helpers
+    void worker(int thread, int cpu);
+};
+
+#endif
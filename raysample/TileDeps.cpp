@@ -0,0 +1,225 @@
+// implementation code for TileDeps class
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "TileDeps.hpp"
+
+// other classes used directly in the implementation
+#include "Object.hpp"
+#include "Ray.hpp"
+#include "World.hpp"
+
+// system includes
+#include <algorithm>
+#include <cmath>
+
+// tile the calling thread is recording for, if any
+struct Recording {
+    const TileDeps *deps;
+    uint64_t *tile;
+};
+static thread_local Recording Current = { 0, 0 };
+
+// grid box around everything rays start from or reach: objects, eye, and
+// lights
+TileDeps::TileDeps(const World &world, int tiles)
+    : lo(INFINITY, INFINITY, INFINITY), hi(-INFINITY, -INFINITY, -INFINITY),
+      objectBits(64), exact(true), beyond(false)
+{
+    lo = min(lo, world.camera.eye);
+    hi = max(hi, world.camera.eye);
+    for(auto &light : world.lights) {
+        float reach = length(light.edge1) + length(light.edge2) + light.radius;
+        lo = min(lo, light.pos - Vec3(reach, reach, reach));
+        hi = max(hi, light.pos + Vec3(reach, reach, reach));
+    }
+    const std::vector<Object*> &objects = world.objects.objects;
+    for(auto obj : objects) {
+        Vec3 blo, bhi;
+        obj->bounds(blo, bhi);
+        for(int a=0; a < 3; ++a) {
+            if (std::isfinite(blo[a])) lo[a] = std::min(lo[a], blo[a]);
+            if (std::isfinite(bhi[a])) hi[a] = std::max(hi[a], bhi[a]);
+        }
+    }
+
+    // pad a little, so nothing sits right on the edge
+    Vec3 pad = 0.01f * (hi - lo) + Vec3(1e-3f, 1e-3f, 1e-3f);
+    lo = lo - pad;
+    hi = hi + pad;
+    cell = (hi - lo) / float(Cells);
+    for(int a=0; a < 3; ++a)
+        perCell[a] = 1 / cell[a];
+
+    while (objectBits < int(objects.size()) && objectBits < (1 << 15))
+        objectBits *= 2;
+    exact = int(objects.size()) <= objectBits;
+    words = objectBits / 64 + GridWords + 1;
+    marks.assign(size_t(tiles) * words, 0);
+}
+
+// clear tile's marks and point the thread at them
+void
+TileDeps::begin(int tile)
+{
+    uint64_t *marked = &marks[size_t(tile) * words];
+    std::fill(marked, marked + words, 0);
+    Current.deps = this;
+    Current.tile = marked;
+}
+
+// back to not recording
+void
+TileDeps::end()
+{
+    Current.deps = 0;
+    Current.tile = 0;
+}
+
+// cells of the new bounds, a little larger all around to allow for
+// rounding in mark's stepping
+void
+TileDeps::edit(const ObjectList &objects, const std::vector<int> &_moved)
+{
+    moved = _moved;
+    changed.assign(GridWords, 0);
+    beyond = false;
+    for(int id : moved) {
+        Vec3 blo, bhi;
+        objects.objects[id]->bounds(blo, bhi);
+        bool finite = true;
+        for(int a=0; a < 3; ++a)
+            finite = finite && std::isfinite(blo[a]) && std::isfinite(bhi[a]);
+        if (!finite) {
+            beyond = true;
+            changed.assign(GridWords, ~uint64_t(0));
+            continue;
+        }
+
+        int c0[3], c1[3];
+        for(int a=0; a < 3; ++a) {
+            if (blo[a] < lo[a] || bhi[a] > hi[a])
+                beyond = true;
+            float slack = 0.01f * cell[a];
+            c0[a] = std::max(int(std::floor((blo[a] - slack - lo[a]) / cell[a])), 0);
+            c1[a] = std::min(int(std::floor((bhi[a] + slack - lo[a]) / cell[a])), Cells - 1);
+        }
+        for(int x = c0[0]; x <= c1[0]; ++x)
+            for(int y = c0[1]; y <= c1[1]; ++y)
+                for(int z = c0[2]; z <= c1[2]; ++z) {
+                    int bit = (x*Cells + y)*Cells + z;
+                    changed[bit / 64] |= uint64_t(1) << (bit % 64);
+                }
+    }
+}
+
+// record for the thread's tile, if it has one
+void
+TileDeps::touched(const Ray &r, float t, int object)
+{
+    if (Current.tile)
+        Current.deps->mark(Current.tile, r, t, object);
+}
+
+// a moved object the tile's rays hit, a segment through its new bounds,
+// or a segment leaving the box when an object now reaches outside it
+bool
+TileDeps::dirty(int tile) const
+{
+    const uint64_t *marked = &marks[size_t(tile) * words];
+    for(int id : moved) {
+        int hashes[2];
+        int count = objectHashes(id, hashes);
+        bool all = true;
+        for(int h=0; h < count; ++h)
+            all = all && (marked[hashes[h] / 64] >> (hashes[h] % 64) & 1);
+        if (all) return true;
+    }
+    const uint64_t *grid = marked + objectBits / 64;
+    for(int w=0; w < GridWords; ++w)
+        if (grid[w] & changed[w]) return true;
+    return beyond && marked[words - 1];
+}
+
+// the object number itself while every object has its own bit, otherwise
+// two mixes of it
+int
+TileDeps::objectHashes(int object, int hashes[2]) const
+{
+    if (exact) {
+        hashes[0] = object;
+        return 1;
+    }
+    uint32_t h = uint32_t(object) * 0x9e3779b1u;
+    h ^= h >> 16;
+    hashes[0] = int(h & (objectBits - 1));
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    hashes[1] = int(h & (objectBits - 1));
+    return 2;
+}
+
+// clip the segment to the box, then walk it a slab of cells at a time
+// along the axis it moves farthest on, in grid coordinates, where cells
+// are 1 on a side; within a slab it moves at most one cell along each
+// other axis, so marking the corners of the range it covers there marks
+// every cell it crosses, with no branches on which way it goes
+void
+TileDeps::mark(uint64_t *tile, const Ray &r, float t, int object) const
+{
+    if (object >= 0) {
+        int hashes[2];
+        int count = objectHashes(object, hashes);
+        for(int h=0; h < count; ++h)
+            tile[hashes[h] / 64] |= uint64_t(1) << (hashes[h] % 64);
+    }
+
+    float g[3], d[3];
+    float enter = -INFINITY, exit = INFINITY;
+    for(int a=0; a < 3; ++a) {
+        g[a] = (r.E[a] - lo[a]) * perCell[a];
+        d[a] = r.D[a] * perCell[a];
+        if (d[a] == 0) {
+            if (g[a] < 0 || g[a] > Cells)
+                enter = INFINITY;
+            continue;
+        }
+        float ta = -g[a] / d[a], tb = (Cells - g[a]) / d[a];
+        enter = std::max(enter, std::min(ta, tb));
+        exit = std::min(exit, std::max(ta, tb));
+    }
+    if (enter > r.near || exit < t)
+        tile[words - 1] = 1;
+    float t0 = std::max(r.near, enter), t1 = std::min(t, exit);
+    if (!(t0 <= t1)) return;
+
+    // m is the axis of the slabs, u and v the others
+    static const int Stride[3] = { Cells*Cells, Cells, 1 };
+    int m = std::fabs(d[1]) > std::fabs(d[0]);
+    m = std::fabs(d[2]) > std::fabs(d[m]) ? 2 : m;
+    int u = (m + 1) % 3, v = (m + 2) % 3;
+    auto cellOf = [](float x) { return std::min(std::max(int(x), 0), Cells - 1); };
+    int first = cellOf(g[m] + t0 * d[m]), last = cellOf(g[m] + t1 * d[m]);
+    int step = d[m] > 0 ? 1 : -1;
+    int slabs = (last - first) * step + 1;
+    float width = 1 / std::fabs(d[m]);
+    float end = (first + (d[m] > 0) - g[m]) / d[m];
+
+    // each slab starts where the last one stopped
+    uint64_t *grid = tile + objectBits / 64;
+    int ua = cellOf(g[u] + t0 * d[u]) * Stride[u], va = cellOf(g[v] + t0 * d[v]) * Stride[v];
+    int base = first * Stride[m];
+    for(int k=0; k < slabs; ++k) {
+        float stop = std::min(end, t1);
+        int ub = cellOf(g[u] + stop * d[u]) * Stride[u];
+        int vb = cellOf(g[v] + stop * d[v]) * Stride[v];
+        unsigned bits[4] = { unsigned(base + ua + va), unsigned(base + ua + vb),
+                             unsigned(base + ub + va), unsigned(base + ub + vb) };
+        for(unsigned b : bits)
+            grid[b / 64] |= uint64_t(1) << (b % 64);
+        ua = ub;
+        va = vb;
+        base += step * Stride[m];
+        end += width;
+    }
+}
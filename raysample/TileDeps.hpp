@@ -0,0 +1,80 @@
+// what each tile's rays touched, for tracing only the tiles an edit can change
+#ifndef TILEDEPS_HPP
+#define TILEDEPS_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Vec3.hpp"
+
+// system includes necessary for the interface
+#include <vector>
+#include <stdint.h>
+
+// classes we only use by pointer or reference
+class World;
+class ObjectList;
+class Ray;
+
+// for each tile, the objects its rays hit or were blocked by, and the
+// cells of a coarse grid over the scene its ray segments crossed, primary,
+// shadow, and secondary alike, recorded by ObjectList::trace and probe
+// while the tile is traced
+// a moved object can only change a tile's pixels if one of its rays hit it
+// where it was, or a segment crosses where it is now, so any other tile is
+// the same as last time and needn't be traced
+// objects go in a Bloom filter, exact while the scene has no more objects
+// than it has bits; segments that leave the grid's box set a flag instead
+class TileDeps {
+private: // private data
+    static const int Cells = 32;    // grid cells along each axis
+    static const int GridWords = Cells*Cells*Cells / 64;
+
+    Vec3 lo, hi;                    // grid box
+    Vec3 cell;                      // size of a cell
+    float perCell[3];               // cells per unit along each axis
+    int objectBits;                 // power of 2
+    bool exact;                     // every object has its own bit
+    int words;                      // per tile: objects, grid, then the flag
+    std::vector<uint64_t> marks;
+
+    // changes set by edit: objects moved, cells their new bounds overlap,
+    // and whether any of them now reach outside the box
+    std::vector<int> moved;
+    std::vector<uint64_t> changed;
+    bool beyond;
+
+public: // constructors
+    // for tiles tiles of world as it is now
+    TileDeps(const World &world, int tiles);
+
+public: // manipulators
+    // record what the calling thread's rays touch for tile, forgetting
+    // what it touched before
+    void begin(int tile);
+
+    // stop recording for the calling thread
+    static void end();
+
+    // the objects numbered in moved have moved in objects: dirty is to
+    // check tiles against their new bounds from now on
+    void edit(const ObjectList &objects, const std::vector<int> &moved);
+
+    // ray r reached t, hitting or blocked by object, or -1 for none
+    // only records anything between begin and end
+    static void touched(const Ray &r, float t, int object);
+
+public: // computational members
+    // whether tile could differ after the last edit
+    bool dirty(int tile) const;
+
+    // bytes used by the marks
+    size_t bytes() const { return marks.size() * sizeof(uint64_t); }
+
+private: // internal helpers
+    // bit positions of object in the filter, returning how many
+    int objectHashes(int object, int hashes[2]) const;
+
+    // mark object and the cells of r from r.near to t in tile's marks
+    void mark(uint64_t *tile, const Ray &r, float t, int object) const;
+};
+
+#endif
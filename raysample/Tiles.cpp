@@ -0,0 +1,133 @@
+// implementation code for tile ordering
+
+// include this class include file FIRST to ensure that it has
+// everything it needs for internal self-consistency
+#include "Tiles.hpp"
+
+// system includes
+#include <algorithm>
+#include <string.h>
+#include <stdint.h>
+
+// interleave bits of x and y: ...y1 x1 y0 x0
+static uint32_t
+morton(uint32_t x, uint32_t y)
+{
+    uint32_t d = 0;
+    for(int b=0; b < 16; ++b)
+        d |= ((x >> b) & 1) << (2*b) | ((y >> b) & 1) << (2*b+1);
+    return d;
+}
+
+// distance of x,y along a Hilbert curve covering an n x n grid, n a power of 2
+static uint32_t
+hilbert(uint32_t n, uint32_t x, uint32_t y)
+{
+    uint32_t d = 0;
+    for(uint32_t s = n/2; s > 0; s /= 2) {
+        uint32_t rx = (x & s) > 0, ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        // rotate quadrant so the sub-curve is in standard orientation
+        if (ry == 0) {
+            if (rx == 1) {
+                x = s-1 - (x & (s-1));
+                y = s-1 - (y & (s-1));
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+// split region into tiles in the given order
+TileList
+makeTiles(const Tile &region, int size, TileOrder order)
+{
+    if (size < 1) size = 1;
+    int tw = (region.width() + size - 1) / size, th = (region.height() + size - 1) / size;
+
+    // curve key for each tile, rows order is just the tile index
+    uint32_t n = 1;
+    while (n < uint32_t(std::max(tw, th))) n *= 2;
+
+    std::vector<std::pair<uint32_t, Tile> > keyed;
+    keyed.reserve(tw * th);
+    for(int ty=0; ty < th; ++ty) {
+        for(int tx=0; tx < tw; ++tx) {
+            uint32_t key =
+                order == MORTON  ? morton(tx, ty) :
+                order == HILBERT ? hilbert(n, tx, ty) :
+                                   uint32_t(ty * tw + tx);
+            keyed.push_back(std::make_pair(key, Tile(
+                region.x0 + tx * size, region.y0 + ty * size,
+                std::min(region.x0 + (tx+1) * size, region.x1),
+                std::min(region.y0 + (ty+1) * size, region.y1))));
+        }
+    }
+    std::stable_sort(keyed.begin(), keyed.end(),
+        [](const std::pair<uint32_t, Tile> &a, const std::pair<uint32_t, Tile> &b) {
+            return a.first < b.first;
+        });
+
+    TileList tiles;
+    tiles.reserve(keyed.size());
+    for(auto &k : keyed)
+        tiles.push_back(k.second);
+    return tiles;
+}
+
+// split region into strips of about equal cost
+TileList
+splitRegion(const Tile &region, const std::vector<double> &bandCost,
+            int bandHeight, int parts)
+{
+    TileList strips;
+    int bands = int(bandCost.size());
+    if (parts < 1) parts = 1;
+
+    // too few bands to balance, just split rows evenly
+    if (bands < parts) {
+        for(int p=0; p < parts; ++p)
+            strips.push_back(Tile(region.x0, region.y0 + region.height() * p / parts,
+                                  region.x1, region.y0 + region.height() * (p+1) / parts));
+        return strips;
+    }
+
+    double total = 0;
+    for(auto c : bandCost)
+        total += c;
+
+    // end each strip at the first band where the running cost passes its
+    // share, leaving at least one band for each strip still to come
+    int start = 0, band = 0;
+    double sum = 0;
+    for(int p=0; p < parts-1; ++p) {
+        double target = total * (p+1) / parts;
+        do
+            sum += bandCost[band++];
+        while (sum < target && band < bands - (parts-1 - p));
+
+        // stop before the band that crossed the target if that's closer
+        if (band - 1 > start && sum - target > target - (sum - bandCost[band-1]))
+            sum -= bandCost[--band];
+
+        strips.push_back(Tile(region.x0, region.y0 + start * bandHeight,
+                              region.x1, region.y0 + band * bandHeight));
+        start = band;
+    }
+    strips.push_back(Tile(region.x0, region.y0 + start * bandHeight,
+                          region.x1, region.y1));
+    return strips;
+}
+
+// parse tile order name
+bool
+parseTileOrder(const char *name, TileOrder &order)
+{
+    if (strcmp(name, "rows") == 0)          order = ROWS;
+    else if (strcmp(name, "morton") == 0)   order = MORTON;
+    else if (strcmp(name, "hilbert") == 0)  order = HILBERT;
+    else return false;
+    return true;
+}
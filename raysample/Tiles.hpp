@@ -0,0 +1,39 @@
+// image tiles and the order they are rendered in
+#ifndef TILES_HPP
+#define TILES_HPP
+
+// system includes necessary for the interface
+#include <vector>
+
+// rectangle of pixels [x0,x1) x [y0,y1)
+struct Tile {
+    int x0, y0, x1, y1;
+    Tile(int _x0=0, int _y0=0, int _x1=0, int _y1=0)
+        : x0(_x0), y0(_y0), x1(_x1), y1(_y1) {}
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+};
+typedef std::vector<Tile> TileList;
+
+// tile traversal orders
+// ROWS goes left to right, top to bottom. MORTON (Z-order) and HILBERT
+// curves keep tiles that run close together in time close together in
+// the image, so they touch more of the same scene data
+enum TileOrder { ROWS, MORTON, HILBERT };
+
+// split a region of the image into size x size tiles in the given order
+// tiles start at the region's corner
+TileList makeTiles(const Tile &region, int size, TileOrder order);
+
+// split region into parts horizontal strips of about equal cost
+// bandCost is the estimated cost of each band of bandHeight rows from the
+// top of the region; strips break between bands when there are at least
+// as many bands as parts, otherwise between rows
+TileList splitRegion(const Tile &region, const std::vector<double> &bandCost,
+                     int bandHeight, int parts);
+
+// parse "rows", "morton", or "hilbert", returning false if unknown
+bool parseTileOrder(const char *name, TileOrder &order);
+
+#endif
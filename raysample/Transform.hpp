@@ -0,0 +1,122 @@
+// affine transforms for placing instances
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+// other classes we use DIRECTLY in our interface
+#include "Vec3.hpp"
+
+// system includes necessary for the interface
+#include <istream>
+#include <string>
+
+// affine transform: p' = col[0]*p.x + col[1]*p.y + col[2]*p.z + offset
+struct Transform {
+    Vec3 col[3];                // linear part, by column
+    Vec3 offset;                // translation
+
+    // identity
+    Transform() : offset(0,0,0) {
+        col[0] = Vec3(1,0,0);
+        col[1] = Vec3(0,1,0);
+        col[2] = Vec3(0,0,1);
+    }
+
+    // basic transforms
+    static Transform translate(const Vec3 &t) {
+        Transform m;
+        m.offset = t;
+        return m;
+    }
+    static Transform scale(float s) {
+        Transform m;
+        for(int k=0; k < 3; ++k) m.col[k] = s * m.col[k];
+        return m;
+    }
+    // rotate by degrees counterclockwise about axis
+    static Transform rotate(const Vec3 &axis, float degrees) {
+        Vec3 a = normalize(axis);
+        float c = cosf(degrees * float(M_PI/180)), s = sinf(degrees * float(M_PI/180));
+        Transform m;
+        for(int k=0; k < 3; ++k) {
+            Vec3 e = m.col[k];  // Rodrigues' formula applied to each basis vector
+            m.col[k] = c*e + s*cross(a, e) + (1-c)*dot(a, e)*a;
+        }
+        return m;
+    }
+
+    // transform point or direction
+    Vec3 point(const Vec3 &p) const {
+        return col[0]*p[0] + col[1]*p[1] + col[2]*p[2] + offset;
+    }
+    Vec3 vector(const Vec3 &v) const {
+        return col[0]*v[0] + col[1]*v[1] + col[2]*v[2];
+    }
+
+    // transform a normal with the inverse transpose, given this inverse
+    Vec3 normal(const Vec3 &n) const {
+        return Vec3(dot(col[0], n), dot(col[1], n), dot(col[2], n));
+    }
+
+    // inverse, by cofactors of the linear part
+    Transform inverse() const {
+        Vec3 r0 = cross(col[1], col[2]), r1 = cross(col[2], col[0]),
+            r2 = cross(col[0], col[1]);
+        float det = dot(col[0], r0);
+        Transform m;
+        m.col[0] = Vec3(r0[0], r1[0], r2[0]) / det;
+        m.col[1] = Vec3(r0[1], r1[1], r2[1]) / det;
+        m.col[2] = Vec3(r0[2], r1[2], r2[2]) / det;
+        m.offset = -m.vector(offset);
+        return m;
+    }
+
+    // read "translate x y z", "rotate x y z degrees", or "scale s" steps,
+    // each applied after the ones before it, stopping at any other token
+    // returns false if a step is malformed
+    bool parse(std::istream &in);
+};
+
+// a after b
+inline Transform operator*(const Transform &a, const Transform &b) {
+    Transform m;
+    for(int k=0; k < 3; ++k)
+        m.col[k] = a.vector(b.col[k]);
+    m.offset = a.point(b.offset);
+    return m;
+}
+
+// parse transform steps
+inline bool Transform::parse(std::istream &in)
+{
+    std::string step;
+    for(;;) {
+        std::streampos before = in.tellg();
+        if (!(in >> step)) {
+            in.clear();
+            return true;
+        }
+        if (step == "translate") {
+            Vec3 t;
+            if (!(in >> t)) return false;
+            *this = translate(t) * *this;
+        }
+        else if (step == "rotate") {
+            Vec3 axis;
+            float degrees;
+            if (!(in >> axis >> degrees)) return false;
+            *this = rotate(axis, degrees) * *this;
+        }
+        else if (step == "scale") {
+            float s;
+            if (!(in >> s)) return false;
+            *this = scale(s) * *this;
+        }
+        else {
+            // leave anything else for the next token
+            in.seekg(before);
+            return true;
+        }
+    }
+}
+
+#endif
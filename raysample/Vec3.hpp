@@ -7,6 +7,9 @@
 
 #include <istream>
 
+// shared SIMD vector math
+#include "float4.hpp"
+
 #ifndef INFINITY
 // don't complain arithmetic overflow to define infinity, I'm doing it on purpose
 #ifdef _WIN32
@@ -18,20 +21,20 @@
 #endif
 
 //////////////////////////////////////////////////////////////////////
-// 3D vector
+// 3D vector, stored in one 16-byte SIMD register with w=0
 class Vec3 {
 private: // private data
-    float data[3];                          // array data
+    float4 data;                            // x, y, z, 0
 
 public: // constructors & destructors
-    Vec3() { data[0] = data[1] = data[2] = 0; }
-    Vec3(float _x, float _y, float _z) { 
-        data[0] = _x; 
-        data[1] = _y; 
-        data[2] = _z;
-    }
+    Vec3() {}
+    Vec3(float _x, float _y, float _z) : data(_x, _y, _z, 0) {}
+    explicit Vec3(const float4 &_data) : data(_data) {}
     // also can use default copy constructor
 
+    // underlying SIMD vector
+    const float4 &simd() const { return data; }
+
 public:
     // access as an array vec[i] rather than vec.data[i]
     float operator[](int i) const { return data[i]; }
@@ -53,40 +56,44 @@ public:
 // component-wise operations: -v, v1+v2, v1-v2, v1*v2, v1/v2
 // operations with a scalar: s*v, v*s, v/s
 // vector operations: cross(v1,v2), dot(v1,v2), length(v), normalize(v)
+// also min(v1,v2), max(v1,v2), fma(a,b,c)
 
 // negate v
 inline Vec3 operator-(const Vec3 &v) {
-    return Vec3(-v[0], -v[1], -v[2]);
+    return Vec3(-v.simd());
 }
 
 // vector addition, v1+v2
 inline Vec3 operator+(const Vec3 &v1, const Vec3 &v2) {
-    return Vec3(v1[0] + v2[0], v1[1] + v2[1], v1[2] + v2[2]);
+    return Vec3(v1.simd() + v2.simd());
 }
 
 // vector subtraction, v1-v2
 inline Vec3 operator-(const Vec3 &v1, const Vec3 &v2) {
-    return Vec3(v1[0] - v2[0], v1[1] - v2[1], v1[2] - v2[2]);
+    return Vec3(v1.simd() - v2.simd());
 }
 
 // vector component-wise multiplication, v1*v2
 inline Vec3 operator*(const Vec3 &v1, const Vec3 &v2) {
-    return Vec3(v1[0] * v2[0], v1[1] * v2[1], v1[2] * v2[2]);
+    return Vec3(v1.simd() * v2.simd());
 }
 
 // vector component-wise division, v1/v2
+// w lanes are both 0, so patch the divisor to keep w a clean 0
 inline Vec3 operator/(const Vec3 &v1, const Vec3 &v2) {
-    return Vec3(v1[0] / v2[0], v1[1] / v2[1], v1[2] / v2[2]);
+    float4 d = v2.simd();
+    d.w = 1;
+    return Vec3(v1.simd() / d);
 }
 
 // scalar multiplication, s*v
 inline Vec3 operator*(float s, const Vec3 &v) {
-    return Vec3(s*v[0], s*v[1], s*v[2]);
+    return Vec3(s * v.simd());
 }
 
 // scalar multiplication, v*s
 inline Vec3 operator*(const Vec3 &v, float s) {
-    return Vec3(s*v[0], s*v[1], s*v[2]);
+    return Vec3(v.simd() * s);
 }
 
 // scalar division, v/s
@@ -94,16 +101,30 @@ inline Vec3 operator/(const Vec3 &v, float s) {
     return v*(1/s);
 }
 
+// component-wise minimum and maximum, min(v1,v2), max(v1,v2)
+inline Vec3 min(const Vec3 &v1, const Vec3 &v2) {
+    return Vec3(min(v1.simd(), v2.simd()));
+}
+inline Vec3 max(const Vec3 &v1, const Vec3 &v2) {
+    return Vec3(max(v1.simd(), v2.simd()));
+}
+
+// multiply-add, fma(a,b,c) = a*b + c
+inline Vec3 fma(const Vec3 &a, const Vec3 &b, const Vec3 &c) {
+    return Vec3(fma(a.simd(), b.simd(), c.simd()));
+}
+inline Vec3 fma(float s, const Vec3 &b, const Vec3 &c) {
+    return Vec3(fma(float4::splat(s), b.simd(), c.simd()));
+}
+
 // cross product, cross(v1,v2)
 inline Vec3 cross(const Vec3 &v1, const Vec3 &v2) {
-    return Vec3(v1[1]*v2[2] - v1[2]*v2[1],
-                v1[2]*v2[0] - v1[0]*v2[2],
-                v1[0]*v2[1] - v1[1]*v2[0]);
+    return Vec3(cross3(v1.simd(), v2.simd()));
 }
 
 // vector dot product, dot(v1,v2)
 inline float dot(const Vec3 &v1, const Vec3 &v2) {
-    return (v1[0] * v2[0] + v1[1] * v2[1] + v1[2] * v2[2]);
+    return dot3(v1.simd(), v2.simd());
 }
 
 // return Euclidean vector length, length(v)
@@ -112,8 +133,9 @@ inline float length(const Vec3 &v) {
 }
 
 // return normalized vector, normalize(v)
+// uses the fast reciprocal square root rather than sqrt and divide
 inline Vec3 normalize(const Vec3 &v) {
-    return v / length(v);
+    return Vec3(normalize3(v.simd()));
 }
 
 inline std::istream& operator>>(std::istream &stream, Vec3 &v) {
@@ -9,6 +9,7 @@
 // local includes
 #include "Polygon.hpp"
 #include "Sphere.hpp"
+#include "Instance.hpp"
 
 // system includes
 #include <math.h>
@@ -17,30 +18,46 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <memory>
 
 // scoped global for what is enabled
 unsigned int World::effects = ~0;
 
+// stochastic modes off by default
+float World::roulette = 0;
+int World::lightSamples = 0;
+int World::pixelSamples = 1;
+
+// refine pixels with more than 10% contrast
+float World::contrast = 0.1f;
+
 // read input file
 World::World(std::istream &ifile)
 {
-    int SphereCount = 0, PolyCount = 0;
+    int SphereCount = 0, PolyCount = 0, InstanceCount = 0, PartCount = 0;
 
     // world state defaults
-    eye = Vec3(0,-8,0);
+    camera.eye = Vec3(0,-8,0);
+    camera.look = Vec3(0,0,0);
+    camera.up = Vec3(0,1,0);
+    camera.xfov = camera.yfov = 45;
     width = height = 512;
     maxdepth = 15;
     cutoff = 0.002;
+    samples = 1;
+    jitter = false;
 
     // temporary variables while parsing
-    Vec3 look(0,0,0), up(0,1,0);
-    float xfov=45, yfov=45;
     std::string surfname;
 
     // map of surface names to colors, only need while parsing
     std::map<std::string, Surface> surfaceMap;
     Surface *currentSurface = &surfaceMap[""];
 
+    // named geometry for instances, and the one being defined, if any
+    std::map<std::string, std::shared_ptr<Geometry> > geometryMap;
+    std::shared_ptr<Geometry> defining;
+
     std::string token;
     while(ifile >> token) {
         if (token == "maxdepth")
@@ -51,15 +68,26 @@ World::World(std::istream &ifile)
         else if (token == "background")
             ifile >> background;
         else if (token == "eyep")
-            ifile >> eye;
+            ifile >> camera.eye;
         else if (token == "lookp")
-            ifile >> look;
+            ifile >> camera.look;
         else if (token == "up")
-            ifile >> up;
+            ifile >> camera.up;
         else if (token == "fov")
-            ifile >> xfov >> yfov;
+            ifile >> camera.xfov >> camera.yfov;
         else if (token == "screen")
             ifile >> width >> height;
+        else if (token == "sample") {
+            ifile >> samples;
+            // optional jitter or nojitter, leave anything else for next token
+            std::streampos before = ifile.tellg();
+            if (ifile >> token && (token == "jitter" || token == "nojitter"))
+                jitter = token == "jitter";
+            else {
+                ifile.clear();
+                ifile.seekg(before);
+            }
+        }
 
         else if (token == "surface") {
             ifile >> surfname;
@@ -85,7 +113,19 @@ World::World(std::istream &ifile)
             float intensity;
             Vec3 position;
             ifile >> intensity >> token >> position;
-            lights.push_back(Light(Vec3(intensity, intensity, intensity), position));
+            Light li(Vec3(intensity, intensity, intensity), position);
+
+            // area lights: rect center edge1 edge2, or sphere center radius
+            // anything else is a point light
+            if (token == "rect") {
+                li.type = Light::RECT;
+                ifile >> li.edge1 >> li.edge2;
+            }
+            else if (token == "sphere") {
+                li.type = Light::SPHERE;
+                ifile >> li.radius;
+            }
+            lights.push_back(li);
         }
         
         else if (token == "polygon") {
@@ -96,7 +136,13 @@ World::World(std::istream &ifile)
                 poly->addVertex(vert);
             ifile.clear();
             poly->closePolygon();
-            if ((World::effects & World::POLYGONS)) {
+            if (!(World::effects & World::POLYGONS))
+                delete poly;
+            else if (defining) {
+                ++PartCount;
+                defining->addPart(poly);
+            }
+            else {
                 ++PolyCount;
                 objects.addObject(poly);
             }
@@ -107,27 +153,106 @@ World::World(std::istream &ifile)
             Vec3 center;
             ifile >> surfname >> radius >> center;
             if ((World::effects & World::SPHERES)) {
-                ++SphereCount;
-                objects.addObject(new Sphere(surfaceMap[surfname], center, radius));
+                Sphere *sphere = new Sphere(surfaceMap[surfname], center, radius);
+                if (defining) {
+                    ++PartCount;
+                    defining->addPart(sphere);
+                }
+                else {
+                    ++SphereCount;
+                    objects.addObject(sphere);
+                }
+            }
+        }
+
+        // define name: objects up to "end" make up geometry for instances
+        else if (token == "define") {
+            ifile >> token;
+            if (defining) defining->close();
+            defining = std::make_shared<Geometry>();
+            geometryMap[token] = defining;
+        }
+        else if (token == "end") {
+            if (defining) defining->close();
+            defining.reset();
+        }
+
+        // instance name [material surface] transform
+        else if (token == "instance") {
+            std::string name;
+            ifile >> name;
+            std::streampos before = ifile.tellg();
+            bool material = ifile >> token && token == "material" && ifile >> surfname;
+            if (!material) {
+                ifile.clear();
+                ifile.seekg(before);
+            }
+            Transform place;
+            if (!place.parse(ifile)) {
+                std::cerr << "Bad transform for instance of " << name << '\n';
+                ifile.clear();
+            }
+
+            // a hit keeps one part number, so instances can't be parts
+            auto found = geometryMap.find(name);
+            if (defining)
+                std::cerr << "Instance of " << name << " inside a definition, "
+                    "which can't hold instances\n";
+            else if (found == geometryMap.end())
+                std::cerr << "Instance of undefined geometry " << name << '\n';
+            else if (found->second->parts.empty())
+                ;   // nothing left after -no-polygons or -no-spheres
+            else {
+                ++InstanceCount;
+                objects.addObject(material
+                    ? new Instance(found->second, place, surfaceMap[surfname])
+                    : new Instance(found->second, place));
             }
         }
     }
 
+    if (defining) defining->close();
+    lightTree.build(lights);
+
+    if (samples < 1) samples = 1;
+
+    std::cout << objects.objects.size() << " Objects (" 
+        << SphereCount << " Sphere" << (SphereCount == 1 ? "" : "s") << ", " 
+        << PolyCount << " Polygon" << (PolyCount == 1 ? "" : "s");
+    if (InstanceCount > 0 || PartCount > 0)
+        std::cout << ", " << InstanceCount << " Instance" << (InstanceCount == 1 ? "" : "s")
+            << " of " << geometryMap.size() << " Definition"
+            << (geometryMap.size() == 1 ? "" : "s")
+            << " with " << PartCount << " Object" << (PartCount == 1 ? "" : "s");
+    std::cout << "); "
+        << lights.size() << " Light" << (lights.size() == 1 ? "" : "s") << '\n';
+}
+
+// view basis for camera
+View::View(const Camera &cam)
+{
     // compute view basis
-    w = eye - look;
+    eye = cam.eye;
+    w = eye - cam.look;
     dist = length(w);
     w = normalize(w);
-    u = normalize(cross(up, w));
+    u = normalize(cross(cam.up, w));
     v = cross(w, u);
 
     // solve for screen edges
-    right = dist * tanf(xfov * M_PI/360);
+    right = dist * tanf(cam.xfov * M_PI/360);
     left = -right;
-    top = dist * tanf(yfov * M_PI/360);
+    top = dist * tanf(cam.yfov * M_PI/360);
     bottom = -top;
+}
 
-    std::cout << objects.objects.size() << " Objects (" 
-        << SphereCount << " Sphere" << (SphereCount == 1 ? "" : "s") << ", " 
-        << PolyCount << " Polygon" << (PolyCount == 1 ? "" : "s") << "); "
-        << lights.size() << " Light" << (lights.size() == 1 ? "" : "s") << '\n';
+// primary ray for view through image position x,y
+const Ray
+World::primary(const View &view, float x, float y) const
+{
+    float us = view.left + (view.right  - view.left) * x/width;
+    float vs = view.top  + (view.bottom - view.top ) * y/height;
+    Vec3 dir = -view.dist * view.w + us * view.u + vs * view.v;
+
+    return Ray(view.eye, dir, 1e-4f, INFINITY, maxdepth, 1, cutoff);
 }
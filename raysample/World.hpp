@@ -5,16 +5,25 @@
 // other classes we use DIRECTLY in our interface
 #include "Vec3.hpp"
 #include "ObjectList.hpp"
+#include "Light.hpp"
+#include "LightTree.hpp"
 #include <fstream>
 #include <vector>
 
-struct Light {
-    Vec3 col;                   // light color
-    Vec3 pos;                   // light position
-    Light() : col(1,1,1), pos(0,0,0) {}
-    Light(Vec3 _col, Vec3 _pos) : col(_col), pos(_pos) {}
+// camera placement, as given in the scene file
+struct Camera {
+    Vec3 eye, look, up;
+    float xfov, yfov;                       // full field of view, in degrees
+};
+
+// view origin and basis parameters for a camera
+struct View {
+    Vec3 eye, w, u, v;
+    float dist, left, right, bottom, top;
+
+    View() {}
+    explicit View(const Camera &cam);
 };
-typedef std::vector<Light> LightList;
 
 class World {
 public: // public data
@@ -31,20 +40,40 @@ public: // public data
     };
     static unsigned int effects;
 
+    // Russian roulette for secondary rays, off if roulette is 0
+    // rays with influence below roulette survive with probability
+    // influence/roulette, and are reweighted to compensate
+    static float roulette;
+
+    // stochastic light selection, off if lightSamples is 0
+    // otherwise, shade each hit with this many lights chosen from lightTree
+    static int lightSamples;
+
+    // samples per pixel to average noise from the stochastic modes
+    static int pixelSamples;
+
     // image size
     int width, height;
 
     // background color
     Vec3 background;
 
-    // view origin and basis parameters
-    Vec3 eye, w, u, v;
-    float dist, left, right, bottom, top;
+    // camera from the scene file
+    Camera camera;
 
     // ray recursion termination
     int maxdepth;
     float cutoff;
 
+    // anti-aliasing: up to samples x samples rays per pixel, 
+    // with random offsets within each sub-pixel if jitter is set
+    int samples;
+    bool jitter;
+
+    // adaptive anti-aliasing: only trace all samples x samples rays if
+    // the first few differ in contrast by more than this
+    static float contrast;
+
 
     // list of objects in the scene
     ObjectList objects;
@@ -52,9 +81,17 @@ public: // public data
     // list of lights
     LightList lights;
 
+    // lights clustered by position for stochastic selection
+    LightTree lightTree;
+
 public:                                                     
     // read world data from a file
     World(std::istream &ifile); 
+
+public: // computational members
+    // primary ray for view through image position x,y, in pixels from
+    // the top left
+    const Ray primary(const View &view, float x, float y) const;
 };
 
 #endif
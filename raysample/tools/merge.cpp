@@ -0,0 +1,82 @@
+// merge ppm or pfm images rendered with -crop or -split into the full image
+// each part says where it goes in a "# crop" header comment
+
+#include "Image.hpp"
+
+#include <iostream>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+// don't complain about MS-deprecated standard C functions
+#pragma warning( disable: 4996 )
+#endif
+
+int main(int argc, char **argv)
+{
+    // parse command line arguments
+    char *progname = argv[0];
+    const char *outname = "merged.ppm";
+    std::vector<char*> parts;
+    for(++argv, --argc;  argc != 0;  ++argv, --argc) {
+        if (strcmp(argv[0], "-o") == 0 && argc > 1 && parts.empty()) {
+            outname = argv[1];
+            ++argv; --argc;
+        }
+        else if (argv[0][0] != '-')
+            parts.push_back(argv[0]);
+        else
+            break;
+    }
+
+    if (parts.empty() || argc != 0) {
+        std::cerr << "Usage: " << progname << " [-o out.ppm|out.pfm] part...\n"
+            << "  assemble parts rendered with -crop or -split\n"
+            << "  output is pfm if its name ends in .pfm (default merged.ppm)\n";
+        return 1;
+    }
+
+    Image full;
+    std::vector<bool> covered;
+    for(auto name : parts) {
+        Image part;
+        if (!part.read(name)) {
+            std::cerr << "Error reading " << name << '\n';
+            return 1;
+        }
+        if (full.pixels.empty()) {
+            full = Image(part.fullWidth, part.fullHeight);
+            covered.assign(size_t(full.width)*full.height, false);
+        }
+        if (part.fullWidth != full.width || part.fullHeight != full.height ||
+            part.x0 < 0 || part.y0 < 0 ||
+            part.x0 + part.width > full.width || part.y0 + part.height > full.height) {
+            std::cerr << name << " doesn't fit a " << full.width << 'x' << full.height
+                << " image\n";
+            return 1;
+        }
+
+        for(int y=0; y < part.height; ++y) {
+            memcpy(full.at(part.x0, part.y0 + y), part.at(0, y),
+                   size_t(part.width)*3*sizeof(float));
+            for(int x=0; x < part.width; ++x)
+                covered[size_t(part.y0 + y)*full.width + part.x0 + x] = true;
+        }
+    }
+
+    size_t missing = 0;
+    for(auto c : covered)
+        missing += !c;
+    if (missing)
+        std::cerr << "Warning: " << missing << " pixels not in any part\n";
+
+    FILE *out = fopen(outname, "wb");
+    if (!out) {
+        std::cerr << "Error opening " << outname << '\n';
+        return 1;
+    }
+    full.write(out, Image::formatOf(outname));
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,99 @@
+// write a scene of many random spheres, for timing acceleration structures
+// spheres fill a cube evenly, or gather in clusters to unbalance the tree
+
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <vector>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char **argv)
+{
+    // parse command line arguments
+    char *progname = argv[0];
+    const char *outname = 0;
+    long count = 1000000;
+    int clusters = 0;
+    unsigned seed = 1;
+    for(++argv, --argc;  argc != 0;  ++argv, --argc) {
+        if (strcmp(argv[0], "-n") == 0 && argc > 1 && atol(argv[1]) > 0) {
+            count = atol(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-clusters") == 0 && argc > 1) {
+            clusters = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-seed") == 0 && argc > 1) {
+            seed = unsigned(atol(argv[1]));
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-o") == 0 && argc > 1) {
+            outname = argv[1];
+            ++argv; --argc;
+        }
+        else
+            break;
+    }
+
+    if (argc != 0) {
+        std::cerr << "Usage: " << progname << " [-n count] [-clusters k] [-seed s] [-o file.ray]\n"
+            << "  count random spheres (default 1000000) in a 2x2x2 cube, or in\n"
+            << "  k clusters, written to file.ray or stdout\n";
+        return 1;
+    }
+
+    std::ofstream file;
+    if (outname) {
+        file.open(outname);
+        if (!file) {
+            std::cerr << "Error opening " << outname << '\n';
+            return 1;
+        }
+    }
+    std::ostream &out = outname ? file : std::cout;
+
+    // camera, lights, and a few surfaces to alternate between
+    out << "background 0.078 0.361 0.753\n"
+        << "eyep 3.2 2.1 2.6\nlookp 0 0 0\nup 0 0 1\nfov 45 45\n"
+        << "screen 512 512\nsample 1 nojitter\n"
+        << "light 0.57735 point 4 3 2\nlight 0.57735 point 1 -4 4\n"
+        << "light 0.57735 point -3 1 5\n"
+        << "surface red\n    diffuse 0.8 0.2 0.2\n    specular 0.3 0.3 0.3\n    specpow 10\n"
+        << "surface green\n    diffuse 0.2 0.7 0.3\n"
+        << "surface mirror\n    diffuse 0.4 0.4 0.5\n    specular 0.5 0.5 0.5\n"
+        << "    specpow 30\n    reflect 0.4\n";
+
+    // spheres about a fifth of their spacing across, so most rays stop
+    // within a few layers
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(-1, 1);
+    std::normal_distribution<float> normal(0, 1);
+    float radius = 0.2f / std::cbrt(float(count));
+    std::vector<float> centers;
+    for(int k=0; k < clusters; ++k)
+        for(int i=0; i < 4; ++i)
+            centers.push_back(i < 3 ? 0.8f * uniform(rng) : 0.05f + 0.15f * fabsf(normal(rng)));
+
+    const char *surfaces[] = {"red", "green", "mirror"};
+    out.precision(6);
+    for(long i=0; i < count; ++i) {
+        float x, y, z;
+        if (clusters > 0) {
+            const float *c = &centers[4 * (i % clusters)];
+            x = c[0] + c[3] * normal(rng);
+            y = c[1] + c[3] * normal(rng);
+            z = c[2] + c[3] * normal(rng);
+        }
+        else {
+            x = uniform(rng);
+            y = uniform(rng);
+            z = uniform(rng);
+        }
+        out << "sphere " << surfaces[i % 3] << ' ' << radius << ' '
+            << x << ' ' << y << ' ' << z << '\n';
+    }
+    return 0;
+}
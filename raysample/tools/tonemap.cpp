@@ -0,0 +1,124 @@
+// tone map a float pfm image to an 8-bit ppm, with exposure and gamma
+// re-grading a finished render this way costs file I/O, not another trace
+
+#include "Image.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+// don't complain about MS-deprecated standard C functions
+#pragma warning( disable: 4996 )
+#endif
+
+int main(int argc, char **argv)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // parse command line arguments
+    char *progname = argv[0];
+    char *filename = nullptr;
+    std::string outname;
+    float exposure = 0;             // in stops
+    float gamma = 1;                // output is radiance^(1/gamma)
+    for(++argv, --argc;  argc != 0;  ++argv, --argc) {
+        if (strcmp(argv[0], "-exposure") == 0 && argc > 2) {
+            exposure = float(atof(argv[1]));
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-gamma") == 0 && argc > 2 && atof(argv[1]) > 0) {
+            gamma = float(atof(argv[1]));
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-o") == 0 && argc > 2) {
+            outname = argv[1];
+            ++argv; --argc;
+        }
+        else if (argc == 1 && argv[0][0] != '-')
+            filename = argv[0];
+        else
+            break;
+    }
+
+    if (!filename || argc != 0) {
+        std::cerr << "Usage: " << progname << " [options] file.pfm\n"
+            << "options:\n"
+            << "  -exposure stops\n"
+            << "    scale radiance by 2^stops (default 0)\n"
+            << "  -gamma g\n"
+            << "    encode with gamma g, 2.2 for typical displays (default 1)\n"
+            << "  -o file.ppm\n"
+            << "    output file (default input name with .ppm)\n";
+        return 1;
+    }
+    if (outname.empty()) {
+        outname = filename;
+        size_t dot = outname.rfind('.');
+        if (dot != std::string::npos && outname.find('/', dot) == std::string::npos)
+            outname.erase(dot);
+        outname += ".ppm";
+    }
+
+    Image image;
+    if (!image.read(filename)) {
+        std::cerr << "Error reading " << filename << '\n';
+        return 1;
+    }
+    auto readTime = std::chrono::high_resolution_clock::now();
+
+    // the output is only 8 bits, so rather than a pow per channel, find the
+    // radiance where each output level starts: level k is the count of
+    // thresholds at or below the radiance
+    //   255 * (v * 2^exposure)^(1/gamma) + 0.5 >= k
+    //   v >= ((k - 0.5)/255)^gamma / 2^exposure
+    float threshold[255];
+    float scale = powf(2, -exposure);
+    for(int k=1; k <= 255; ++k)
+        threshold[k-1] = powf((k - .5f) / 255, gamma) * scale;
+
+    // table of the level at the start of each bucket of floats sharing
+    // sign, exponent, and top 8 mantissa bits; a bucket is narrower than
+    // the gap between levels unless gamma is small, so the level of any
+    // float is its bucket's level or just above
+    // positive floats sort like their bits, negative ones are all level 0
+    std::vector<unsigned char> level(1 << 17, 0);
+    for(uint32_t b=0, k=0; b < level.size()/2; ++b) {
+        uint32_t bits = b << 15;
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        while (k < 255 && threshold[k] <= v) ++k;
+        level[b] = (unsigned char)k;
+    }
+
+    std::vector<unsigned char> bytes(image.pixels.size());
+    for(size_t i=0; i < bytes.size(); ++i) {
+        float v = image.pixels[i];
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        int k = level[bits >> 15];
+        while (k < 255 && threshold[k] <= v) ++k;
+        bytes[i] = (unsigned char)k;
+    }
+    auto mapTime = std::chrono::high_resolution_clock::now();
+
+    FILE *out = fopen(outname.c_str(), "wb");
+    if (!out) {
+        std::cerr << "Error opening " << outname << '\n';
+        return 1;
+    }
+    Image::writeHeader(out, Image::PPM, image.width, image.height);
+    fwrite(bytes.data(), 1, bytes.size(), out);
+    fclose(out);
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<float, std::milli> read = readTime - startTime,
+        map = mapTime - readTime, write = endTime - mapTime;
+    std::cout << image.width << 'x' << image.height << ": read " << read.count()
+        << " ms, map " << map.count() << " ms, write " << write.count() << " ms\n";
+    return 0;
+}
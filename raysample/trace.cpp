@@ -8,39 +8,236 @@
 #include "Ray.hpp"
 #include "World.hpp"
 #include "Vec3.hpp"
+#include "Sampler.hpp"
+#include "Tiles.hpp"
+#include "ThreadPool.hpp"
+#include "CacheCounters.hpp"
+#include "Image.hpp"
+#include "BandWriter.hpp"
+#include "Checkpoint.hpp"
+#include "Budget.hpp"
+#include "Animation.hpp"
+#include "Pager.hpp"
+#include "ShadeCache.hpp"
+#include "TileDeps.hpp"
+#include "TemporalCache.hpp"
 
 // standard includes
 #include <vector>
+#include <algorithm>
 #include <fstream>
-#include <iostream>
+#include <sstream>
+#include <string>
+#include <memory>
+#include <iterator>
+#include <map>
 #include <thread>
+#include <iostream>
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <stdio.h>
 
 #ifdef _WIN32
 // don't complain about MS-deprecated standard C functions
 #pragma warning( disable: 4996 )
+#include <io.h>
+#include <fcntl.h>
+#include <intrin.h>
+#define popen _popen
+#define pclose _pclose
+#else
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #endif
+#include <sys/stat.h>
 
-int main(int argc, char **argv)
+// read two ppm or pfm files and print the RMSE between them, in 8-bit units
+// used to measure the noise of stochastic modes against a deterministic render
+static void
+compareImages(const char *filename, const char *reference)
 {
-    auto startTime = std::chrono::high_resolution_clock::now();
+    Image image, ref;
+    if (!image.read(filename) || !ref.read(reference)) {
+        std::cerr << "Error reading " << (image.pixels.empty() ? filename : reference) << '\n';
+        return;
+    }
+    if (image.width != ref.width || image.height != ref.height) {
+        std::cerr << reference << " is " << ref.width << 'x' << ref.height 
+            << ", not " << image.width << 'x' << image.height << '\n';
+        return;
+    }
 
-    // parse the intput into everything we know about the world
-    // parse command line arguments
-    char *filename = nullptr;
-    char *progname = argv[0];
-    for(++argv, --argc;  argc != 0;  ++argv, --argc) {
+    double sum = 0;
+    for(size_t i=0; i < ref.pixels.size(); ++i) {
+        double diff = double(Image::quantize(image.pixels[i])) - Image::quantize(ref.pixels[i]);
+        sum += diff*diff;
+    }
+    std::cout << "RMSE vs " << reference << ": " 
+        << sqrt(sum / ref.pixels.size()) << " (of 255)\n";
+}
+
+// open output: "-" for stdout, "|command" to pipe to command, else a file
+// for stdout, messages that would go there move to stderr
+static FILE *
+openOutput(const char *name)
+{
+    if (strcmp(name, "-") == 0) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+        return stdout;
+#else
+        int fd = dup(1);
+        dup2(2, 1);
+        return fdopen(fd, "wb");
+#endif
+    }
+    if (name[0] == '|')
+        return popen(name+1, "w");
+    return fopen(name, "wb");
+}
+
+// options for one render, from the command line or a server job line
+struct Job {
+    std::string filename;           // scene file
+    std::string compare;            // reference image, if any
+    int threads;                    // 0 for one per hardware thread
+    int tileSize;
+    TileOrder order;
+    ThreadPool::Affinity affinity;
+    bool cacheStats;
+    std::string outname;            // trace.ppm, or trace.part<i>.ppm for -split
+    Tile crop;                      // whole image unless given
+    int split, part;
+    float checkpointInterval;       // seconds, 0 for no checkpoints
+    bool resume;
+    int window;                     // 0 to keep every band
+    Image::Format format;
+    bool formatGiven;               // else from output name
+
+    // camera overrides
+    bool setEye, setLook, setUp, setFov;
+    Camera camera;
+
+    // several views: a file of cameras, or n cameras orbiting the scene's
+    std::string cameraFile;
+    int orbit;
+
+    // preview passes at 1/16 and 1/4 of the pixels before the full image
+    bool progressive;
+
+    // seconds to finish tracing in, lowering quality as needed; 0 for none
+    float budget;
+
+    // acceleration structure, treelet passes for it, and whether to time
+    // its build across thread counts
+    ObjectList::Accel accel;
+    int treelets;
+    bool buildBench;
+
+    // primary rays in flight at once per thread, interleaving their LBVH
+    // traversal, 0 or 1 to trace one at a time, and whether to time
+    // first-hit traversal plain and interleaved
+    int interleave;
+    bool traceBench;
+
+    // shade interleaved primary hits in batches sharing a surface
+    bool batchShade;
+
+    // animation frames file, if any, and how far the LBVH's surface area
+    // cost may grow, relative to a fresh build, before refits give way to
+    // a rebuild
+    std::string framesFile;
+    float refitLimit;
+
+    // between frames, trace only the tiles whose rays touched what moved
+    bool incremental;
+
+    // as the camera moves between frames, reuse the shadows of primary
+    // hits within this fraction of their distance from the eye of the last
+    // frame's, 0 for never
+    float temporal;
+
+    // page file to page geometry in from, if not empty, and megabytes of
+    // decoded geometry to keep in memory from it
+    std::string pageFile;
+    int pageCache;
+
+    // file of recorded hits to shade from when only surface and light
+    // colors have changed, or to record them in, if not empty, with how
+    // many bounces deep and how many megabytes of them to keep
+    std::string reshadeFile;
+    int reshadeBounces, reshadeLimit;
+
+    // serve jobs from stdin ("-") or a UNIX socket, if not empty
+    std::string server;
+
+    Job() : threads(0), tileSize(16), order(HILBERT), affinity(ThreadPool::NONE),
+            cacheStats(false), crop(0, 0, -1, -1), split(1), part(0),
+            checkpointInterval(0), resume(false), window(0), format(Image::PPM),
+            formatGiven(false), setEye(false), setLook(false), setUp(false),
+            setFov(false), orbit(0), progressive(false), budget(0),
+            accel(ObjectList::LBVH), treelets(0), buildBench(false), interleave(0),
+            traceBench(false), batchShade(false), refitLimit(1.5f), incremental(false),
+            temporal(0),
+            pageCache(64), reshadeBounces(2), reshadeLimit(256) {}
+};
+
+// options kept in class statics
+// saved so every server job starts from the server's own options
+struct Settings {
+    unsigned int effects;
+    float roulette, contrast;
+    int lightSamples, pixelSamples, shadowSamples;
+
+    Settings() : effects(World::effects), roulette(World::roulette),
+                 contrast(World::contrast), lightSamples(World::lightSamples),
+                 pixelSamples(World::pixelSamples), shadowSamples(Light::shadowSamples) {}
+
+    void restore() const {
+        World::effects = effects;
+        World::roulette = roulette;
+        World::contrast = contrast;
+        World::lightSamples = lightSamples;
+        World::pixelSamples = pixelSamples;
+        Light::shadowSamples = shadowSamples;
+    }
+};
+
+// where the time for one render went, in seconds
+struct Latency {
+    std::chrono::high_resolution_clock::time_point start;   // of the job
+    float lookup;                   // finding or parsing the scene
+    float trace;                    // rendering all tiles
+    float write;                    // writing bands, mostly while tracing
+    Latency() : start(std::chrono::high_resolution_clock::now()),
+                lookup(0), trace(0), write(0) {}
+};
+
+// seconds the last render in this process took to write its images, kept
+// from a budgeted render's time to write its own
+static float LastWrite = 0;
+
+// parse options and scene file name into job, and static settings
+// returns false if there's anything it doesn't understand
+static bool
+parseJob(int argc, char **argv, Job &job)
+{
+    for(;  argc != 0;  ++argv, --argc) {
         // print usage on -h, -help, -?, --h, --help, etc.
-        if (strncmp(argv[0], "-h", 2) == 0 || 
-                strncmp(argv[0], "--h", 3) == 0 || 
+        if (strncmp(argv[0], "-h", 2) == 0 ||
+                strncmp(argv[0], "--h", 3) == 0 ||
                 strcmp(argv[0], "-?") == 0)
-            break;
+            return false;
 
         if (strcmp(argv[0], "-no-parallel") == 0)
             World::effects &= ~World::PARALLEL;
         else if (strcmp(argv[0], "-no-ambient") == 0)
             World::effects &= ~World::AMBIENT;
-        else if (strcmp(argv[0], "-no-diffuse") == 0) 
+        else if (strcmp(argv[0], "-no-diffuse") == 0)
             World::effects &= ~World::DIFFUSE;
         else if (strcmp(argv[0], "-no-specular") == 0)
             World::effects &= ~World::SPECULAR;
@@ -54,85 +251,1470 @@ int main(int argc, char **argv)
             World::effects &= ~World::POLYGONS;
         else if (strcmp(argv[0], "-no-spheres") == 0)
             World::effects &= ~World::SPHERES;
+        else if (strcmp(argv[0], "-roulette") == 0 && argc > 3 && atoi(argv[2]) > 0) {
+            World::roulette = float(atof(argv[1]));
+            World::pixelSamples = atoi(argv[2]);
+            argv += 2; argc -= 2;
+        }
+        else if (strcmp(argv[0], "-light-samples") == 0 && argc > 3 &&
+                 atoi(argv[1]) > 0 && atoi(argv[2]) > 0) {
+            World::lightSamples = atoi(argv[1]);
+            World::pixelSamples = atoi(argv[2]);
+            argv += 2; argc -= 2;
+        }
+        else if (strcmp(argv[0], "-shadow-samples") == 0 && argc > 2 &&
+                 atoi(argv[1]) > 0) {
+            Light::shadowSamples = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-contrast") == 0 && argc > 2) {
+            World::contrast = float(atof(argv[1]));
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-threads") == 0 && argc > 2) {
+            job.threads = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-tile") == 0 && argc > 2) {
+            job.tileSize = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-order") == 0 && argc > 2 &&
+                 parseTileOrder(argv[1], job.order)) {
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-affinity") == 0 && argc > 2 &&
+                 ThreadPool::parseAffinity(argv[1], job.affinity)) {
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-cache-stats") == 0)
+            job.cacheStats = true;
+        else if (strcmp(argv[0], "-o") == 0 && argc > 2) {
+            job.outname = argv[1];
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-crop") == 0 && argc > 5) {
+            job.crop = Tile(atoi(argv[1]), atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+            argv += 4; argc -= 4;
+        }
+        else if (strcmp(argv[0], "-split") == 0 && argc > 2 && atoi(argv[1]) > 0) {
+            job.split = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-part") == 0 && argc > 2) {
+            job.part = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-checkpoint") == 0 && argc > 2 && atof(argv[1]) > 0) {
+            job.checkpointInterval = float(atof(argv[1]));
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-resume") == 0)
+            job.resume = true;
+        else if (strcmp(argv[0], "-format") == 0 && argc > 2 &&
+                 Image::parseFormat(argv[1], job.format)) {
+            job.formatGiven = true;
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-window") == 0 && argc > 2) {
+            job.window = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-compare") == 0 && argc > 2) {
+            job.compare = argv[1];
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-eye") == 0 && argc > 4) {
+            job.camera.eye = Vec3(float(atof(argv[1])), float(atof(argv[2])), float(atof(argv[3])));
+            job.setEye = true;
+            argv += 3; argc -= 3;
+        }
+        else if (strcmp(argv[0], "-look") == 0 && argc > 4) {
+            job.camera.look = Vec3(float(atof(argv[1])), float(atof(argv[2])), float(atof(argv[3])));
+            job.setLook = true;
+            argv += 3; argc -= 3;
+        }
+        else if (strcmp(argv[0], "-up") == 0 && argc > 4) {
+            job.camera.up = Vec3(float(atof(argv[1])), float(atof(argv[2])), float(atof(argv[3])));
+            job.setUp = true;
+            argv += 3; argc -= 3;
+        }
+        else if (strcmp(argv[0], "-fov") == 0 && argc > 3) {
+            job.camera.xfov = float(atof(argv[1]));
+            job.camera.yfov = float(atof(argv[2]));
+            job.setFov = true;
+            argv += 2; argc -= 2;
+        }
+        else if (strcmp(argv[0], "-cameras") == 0 && argc > 2) {
+            job.cameraFile = argv[1];
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-orbit") == 0 && argc > 2 && atoi(argv[1]) > 0) {
+            job.orbit = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-progressive") == 0)
+            job.progressive = true;
+        else if (strcmp(argv[0], "-budget") == 0 && argc > 2 &&
+                 Budget::parse(argv[1], job.budget)) {
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-accel") == 0 && argc > 2 &&
+                 ObjectList::parseAccel(argv[1], job.accel)) {
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-treelets") == 0 && argc > 2) {
+            job.treelets = std::max(atoi(argv[1]), 0);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-build-bench") == 0)
+            job.buildBench = true;
+        else if (strcmp(argv[0], "-interleave") == 0 && argc > 2) {
+            job.interleave = std::max(atoi(argv[1]), 0);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-trace-bench") == 0)
+            job.traceBench = true;
+        else if (strcmp(argv[0], "-batch-shade") == 0)
+            job.batchShade = true;
+        else if (strcmp(argv[0], "-frames") == 0 && argc > 2) {
+            job.framesFile = argv[1];
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-refit-limit") == 0 && argc > 2 && atof(argv[1]) >= 1) {
+            job.refitLimit = float(atof(argv[1]));
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-incremental") == 0)
+            job.incremental = true;
+        else if (strcmp(argv[0], "-temporal") == 0 && argc > 2 && atof(argv[1]) > 0) {
+            job.temporal = float(atof(argv[1]));
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-paged") == 0 && argc > 2) {
+            job.pageFile = argv[1];
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-page-cache") == 0 && argc > 2 && atoi(argv[1]) > 0) {
+            job.pageCache = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-reshade") == 0 && argc > 2) {
+            job.reshadeFile = argv[1];
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-reshade-bounces") == 0 && argc > 2 && atoi(argv[1]) >= 0) {
+            job.reshadeBounces = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-reshade-mb") == 0 && argc > 2 && atoi(argv[1]) > 0) {
+            job.reshadeLimit = atoi(argv[1]);
+            ++argv; --argc;
+        }
+        else if (strcmp(argv[0], "-server") == 0 && argc > 1) {
+            job.server = argv[1];
+            ++argv; --argc;
+        }
         else if (argc == 1)
-            filename = argv[0];
+            job.filename = argv[0];
         else
-            break;
-    }
-
-    // unparsed arguments? print usage and exit
-    if (!filename || argc != 0) {
-        std::cerr << "Usage: " << progname << " [options] file.ray\n" 
-            << "options:\n"
-            << "  -no-parallel\n"
-            << "  -no-ambient, -no-diffuse, -no-specular\n"
-            << "  -no-shadow, -no-reflect, -no-refract\n"
-            << "  -no-polygons, -no-spheres\n"
-            << "    turn off ray-tracing features\n"
-            << "output in trace.ppm\n";
+            return false;
+    }
+    if (job.part < 0 || job.part >= job.split)
+        return false;
+
+    // progressive passes rewrite the whole image, so don't mix with
+    // anything that splits it up or streams it a band at a time
+    bool multiview = !job.cameraFile.empty() || job.orbit > 1;
+    bool animated = !job.framesFile.empty();
+    if (job.progressive && (multiview || animated || job.split > 1 || job.window > 0 ||
+                            job.checkpointInterval > 0 || job.resume || job.budget > 0))
+        return false;
+
+    // animations are a single view, each frame of it from a new camera
+    if (animated && multiview)
+        return false;
+
+    // reused tiles have to be at full quality, and from the frame before
+    if (job.incremental && (!animated || job.budget > 0))
+        return false;
+
+    // reused shadows are for full quality frames that trace every tile
+    if (job.temporal > 0 && (!animated || job.budget > 0 || job.incremental))
+        return false;
+
+    // batches are filled from interleaved primary hits
+    if (job.batchShade && job.interleave < 2)
+        return false;
+
+    // paged clusters stay put, so can't be animated
+    if (animated && !job.pageFile.empty())
+        return false;
+
+    // recorded hits are for every pixel of one view at full quality
+    if (!job.reshadeFile.empty() && (multiview || animated || job.progressive ||
+                                     job.split > 1 || job.budget > 0 ||
+                                     job.checkpointInterval > 0 || job.resume))
+        return false;
+
+    // splits, checkpoints, stdout, and pipes are for a single image
+    return !(multiview || animated) ||
+        (job.split == 1 && job.checkpointInterval == 0 && !job.resume &&
+         job.outname != "-" && job.outname.compare(0, 1, "|") != 0);
+}
+
+// print command line options
+static void
+usage(const char *progname)
+{
+    std::cerr << "Usage: " << progname << " [options] file.ray\n"
+        << "       " << progname << " [options] -server -|socket\n"
+        << "options:\n"
+        << "  -no-parallel\n"
+        << "  -no-ambient, -no-diffuse, -no-specular\n"
+        << "  -no-shadow, -no-reflect, -no-refract\n"
+        << "  -no-polygons, -no-spheres\n"
+        << "    turn off ray-tracing features\n"
+        << "  -roulette threshold samples\n"
+        << "    Russian roulette for reflected and refracted rays with\n"
+        << "    influence below threshold, averaging samples per pixel\n"
+        << "  -light-samples count samples\n"
+        << "    shade with count lights chosen from a light hierarchy,\n"
+        << "    averaging samples per pixel\n"
+        << "  -contrast c\n"
+        << "    with 'sample n' in the scene, trace all n x n rays only\n"
+        << "    for pixels with contrast above c (default 0.1)\n"
+        << "  -shadow-samples n\n"
+        << "    shadow rays for area lights in penumbra (default 16)\n"
+        << "  -threads n\n"
+        << "    render with n threads (default one per hardware thread)\n"
+        << "  -tile n\n"
+        << "    render in n x n pixel tiles (default 16)\n"
+        << "  -order rows|morton|hilbert\n"
+        << "    tile traversal order (default hilbert)\n"
+        << "  -affinity none|compact|scatter\n"
+        << "    pin render threads to cores (default none)\n"
+        << "  -cache-stats\n"
+        << "    count L1D and last-level cache read misses while rendering\n"
+        << "  -compare ref.ppm\n"
+        << "    print RMSE of the result against ref.ppm or ref.pfm\n"
+        << "  -o file\n"
+        << "    write to file instead of trace.ppm, - for stdout,\n"
+        << "    or |command to pipe to command\n"
+        << "  -format ppm|pfm\n"
+        << "    8-bit ppm, or float radiance pfm for later tone mapping\n"
+        << "    (default pfm if the output name ends in .pfm, else ppm)\n"
+        << "  -crop x0 y0 x1 y1\n"
+        << "    render only pixels x0 <= x < x1, y0 <= y < y1\n"
+        << "  -split k -part i\n"
+        << "    render part i (0 to k-1) of k strips of about equal\n"
+        << "    estimated cost, for tools/merge to put back together\n"
+        << "  -checkpoint seconds\n"
+        << "    save finished tiles to output.ckpt this often\n"
+        << "  -resume\n"
+        << "    reuse tiles from output.ckpt, if it is from the same\n"
+        << "    scene and options, and trace only the rest\n"
+        << "  -window n\n"
+        << "    keep at most n bands of tiles in memory, writing each\n"
+        << "    band as soon as it and all bands above it are done\n"
+        << "  -eye x y z, -look x y z, -up x y z, -fov x y\n"
+        << "    override the scene's camera\n"
+        << "  -cameras file\n"
+        << "    render a view for each line of file, each with any of\n"
+        << "    eyep, lookp, up, or fov as in a scene file\n"
+        << "  -orbit n\n"
+        << "    render n views evenly spaced around the camera's up axis\n"
+        << "    with several views, each output name gets the view number\n"
+        << "    (out.0000.ppm, out.0001.ppm, ...), and their tiles are\n"
+        << "    interleaved; not with -split, -checkpoint, or -resume\n"
+        << "  -progressive\n"
+        << "    trace every 4th pixel of every 4th row, then every 2nd,\n"
+        << "    then the rest, writing an upscaled image after each pass;\n"
+        << "    not with several views, -split, -window, checkpoints, or -budget\n"
+        << "  -budget time\n"
+        << "    finish within time (250ms, 2s) of starting the job, parsing\n"
+        << "    and building included, dropping anti-aliasing, then\n"
+        << "    reflection and refraction depth, for tiles that would not\n"
+        << "    fit; tiles started past the deadline get the background;\n"
+        << "    the time the last render took to write is kept for writing\n"
+        << "  -accel list|lbvh|qbvh\n"
+        << "    test every object, walk a linear BVH built over them\n"
+        << "    in parallel from Morton codes (default lbvh), or a 4-wide\n"
+        << "    BVH collapsed from it with 8-bit child bounds, for less memory\n"
+        << "  -treelets n\n"
+        << "    n passes rearranging groups of up to 5 BVH subtrees for\n"
+        << "    a lower surface area cost, for faster traces (default 0)\n"
+        << "  -build-bench\n"
+        << "    time BVH builds with 1, 2, 4, ... threads before rendering\n"
+        << "  -interleave n\n"
+        << "    trace n primary rays at once on each thread through the\n"
+        << "    LBVH, each prefetching its next nodes while the others take\n"
+        << "    a step, for scenes too big for the cache (default 0, one\n"
+        << "    at a time); only with one ray per pixel\n"
+        << "  -trace-bench\n"
+        << "    time first hits of the primary rays on one thread, one at a\n"
+        << "    time and interleaved 2, 4, ... 32 at once, before rendering\n"
+        << "  -batch-shade\n"
+        << "    shade the interleaved primary hits 8 at a time, in vector\n"
+        << "    lanes, when they share a surface, gathering their shadow\n"
+        << "    rays a light at a time; only with -interleave\n"
+        << "  -frames file\n"
+        << "    render an animation, one numbered image per frame of file,\n"
+        << "    each frame moving objects or the camera before it's traced;\n"
+        << "    not with several views, -progressive, -split, -checkpoint,\n"
+        << "    or -resume\n"
+        << "  -refit-limit r\n"
+        << "    between frames, refit the LBVH to moved objects until its\n"
+        << "    surface area cost is r times a fresh build's, then rebuild\n"
+        << "    (default 1.5)\n"
+        << "  -incremental\n"
+        << "    with -frames, record what each tile's rays hit and pass\n"
+        << "    through, and trace only the tiles that could see what moved,\n"
+        << "    keeping the rest from the frame before; not with -budget\n"
+        << "  -temporal t\n"
+        << "    with -frames, project each primary hit into the frame before,\n"
+        << "    and if it's on the same object within t times its distance\n"
+        << "    from the eye, reuse that hit's light visibilities instead of\n"
+        << "    tracing shadow rays; not after objects move, with\n"
+        << "    anti-aliasing, -roulette, or -light-samples, and not with\n"
+        << "    -budget or -incremental\n"
+        << "  -paged file.pages\n"
+        << "    keep only clusters of nearby objects in memory, paging their\n"
+        << "    objects in from file.pages as rays reach them; file.pages is\n"
+        << "    written from the scene first if it's missing, older, cut\n"
+        << "    short, or was written with different -no-polygons or\n"
+        << "    -no-spheres;\n"
+        << "    spheres and polygons only, not with -frames\n"
+        << "  -page-cache MB\n"
+        << "    memory for paged-in objects (default 64)\n"
+        << "  -reshade file\n"
+        << "    record each pixel's hits and shadows in file, and if file\n"
+        << "    already holds them for the same scene, views, and options,\n"
+        << "    apart from ambient, diffuse, and specular colors, specpow,\n"
+        << "    light intensities, and the background, shade from them\n"
+        << "    without tracing; only with one ray per pixel, for one view\n"
+        << "  -reshade-bounces k\n"
+        << "    record hits up to k bounces deep, tracing deeper pixels\n"
+        << "    again (default 2)\n"
+        << "  -reshade-mb MB\n"
+        << "    memory for recorded hits (default 256)\n"
+        << "  -server -|socket\n"
+        << "    render jobs read a line at a time from stdin or a UNIX\n"
+        << "    socket, each line options and a scene file as above,\n"
+        << "    keeping threads and parsed scenes between jobs\n";
+}
+
+// cameras for job: the scene's, with any overrides, and then either
+// that alone, the list from a camera file, or an orbit around it
+// returns false if the camera file can't be read
+static bool
+jobCameras(const World &world, const Job &job, std::vector<Camera> &cameras)
+{
+    Camera base = world.camera;
+    if (job.setEye) base.eye = job.camera.eye;
+    if (job.setLook) base.look = job.camera.look;
+    if (job.setUp) base.up = job.camera.up;
+    if (job.setFov) {
+        base.xfov = job.camera.xfov;
+        base.yfov = job.camera.yfov;
+    }
+
+    cameras.clear();
+    if (!job.cameraFile.empty()) {
+        // one camera per line, in scene file syntax, changing the base camera
+        std::ifstream in(job.cameraFile);
+        if (!in) return false;
+        for(std::string line; std::getline(in, line); ) {
+            std::istringstream words(line);
+            Camera cam = base;
+            bool any = false;
+            for(std::string token; words >> token; any = true) {
+                if (token[0] == '#') break;
+                if (token == "eyep") words >> cam.eye;
+                else if (token == "lookp") words >> cam.look;
+                else if (token == "up") words >> cam.up;
+                else if (token == "fov") words >> cam.xfov >> cam.yfov;
+                else return false;
+            }
+            if (any) cameras.push_back(cam);
+        }
+        return !cameras.empty();
+    }
+
+    if (job.orbit > 0) {
+        // rotate the eye around the up axis through the look point
+        Vec3 axis = normalize(base.up);
+        Vec3 offset = base.eye - base.look;
+        Vec3 along = dot(offset, axis) * axis;
+        Vec3 across = offset - along, side = cross(axis, across);
+        for(int k=0; k < job.orbit; ++k) {
+            float angle = float(2*M_PI * k / job.orbit);
+            Camera cam = base;
+            cam.eye = base.look + along + cosf(angle) * across + sinf(angle) * side;
+            cameras.push_back(cam);
+        }
+        return true;
+    }
+
+    cameras.push_back(base);
+    return true;
+}
+
+// output names for job, one per view
+// with several views, each gets its view number before the extension
+static std::vector<std::string>
+outputNames(const Job &job, int views)
+{
+    std::string name = job.outname;
+    if (name.empty()) {
+        std::ostringstream def;
+        def << "trace";
+        if (job.split > 1) def << ".part" << job.part;
+        def << (job.formatGiven && job.format == Image::PFM ? ".pfm" : ".ppm");
+        name = def.str();
+    }
+
+    std::vector<std::string> names;
+    if (views == 1) {
+        names.push_back(name);
+        return names;
+    }
+    size_t dot = name.rfind('.');
+    if (dot == std::string::npos || name.find('/', dot) != std::string::npos)
+        dot = name.size();
+    for(int v=0; v < views; ++v) {
+        char number[16];
+        snprintf(number, sizeof(number), ".%04d", v);
+        names.push_back(name.substr(0, dot) + number + name.substr(dot));
+    }
+    return names;
+}
+
+// close an output file or pipe
+static void
+closeOutput(const std::string &outname, FILE *output)
+{
+    if (outname[0] == '|')
+        pclose(output);
+    else
+        fclose(output);
+}
+
+// make sure pool has the threads, pinning, and tile scratch job needs
+static void
+preparePool(const Job &job, std::unique_ptr<ThreadPool> &pool)
+{
+    int tileSize = std::max(job.tileSize, 1);
+    int threads = !(World::effects & World::PARALLEL) ? 1 :
+        job.threads > 0 ? job.threads : std::max(1, int(std::thread::hardware_concurrency()));
+    size_t scratchBytes = tileSize*tileSize*sizeof(Vec3);
+    if (!pool || pool->size() != threads || pool->affinity() != job.affinity ||
+        pool->scratchSize() < scratchBytes)
+        pool.reset(new ThreadPool(threads, job.affinity, scratchBytes));
+}
+
+// time builds of world's objects into an LBVH with 1, 2, 4, ... threads,
+// up to maxThreads, printing the best of three builds for each
+static void
+benchBuild(const World &world, const Job &job, int maxThreads)
+{
+    const ObjectList::ObjList &objects = world.objects.objects;
+    Bvh bvh;
+    for(int threads=1; ; threads = std::min(2*threads, maxThreads)) {
+        ThreadPool pool(threads, job.affinity);
+        double best = INFINITY;
+        for(int k=0; k < 3; ++k) {
+            auto buildStart = std::chrono::high_resolution_clock::now();
+            bvh.build(objects, job.treelets, &pool);
+            std::chrono::duration<double> built =
+                std::chrono::high_resolution_clock::now() - buildStart;
+            best = std::min(best, built.count());
+        }
+        std::cout << "build with " << threads << " thread" << (threads == 1 ? "" : "s")
+            << ": " << 1000 * best << " ms, "
+            << objects.size() / best / 1e6 << " M objects/s\n";
+        if (threads >= maxThreads) break;
+    }
+}
+
+// region of the image for job, empty if the crop misses the image
+static Tile
+jobRegion(const World &world, const Job &job)
+{
+    Tile crop = job.crop;
+    if (crop.x1 < 0) crop = Tile(0, 0, world.width, world.height);
+    return Tile(std::max(crop.x0, 0), std::max(crop.y0, 0),
+                std::min(crop.x1, world.width), std::min(crop.y1, world.height));
+}
+
+// processor time stamp, in cycles where there is one
+static inline uint64_t
+cycles()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    return __builtin_ia32_rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// time first hits of camera's primary rays through an LBVH of world's
+// objects on the calling thread, in tile order, one at a time and then
+// interleaved by 2, 4, ... 32, printing the best of three runs for each
+// with cycles, the last-level cache misses behind them, and the hits
+// compared with the one at a time ones
+static void
+benchTrace(const World &world, const Job &job, const Camera &camera)
+{
+    const ObjectList::ObjList &objects = world.objects.objects;
+    Bvh bvh;
+    bvh.build(objects, job.treelets, 0);
+
+    View view(camera);
+    std::vector<Ray> rays;
+    for(auto &tile : makeTiles(jobRegion(world, job), std::max(job.tileSize, 1), job.order))
+        for(int j=tile.y0; j < tile.y1; ++j)
+            for(int i=tile.x0; i < tile.x1; ++i)
+                rays.push_back(world.primary(view, i + 0.5f, j + 0.5f));
+    int count = int(rays.size());
+    if (count == 0) return;
+
+    std::vector<Intersection> plain(count), hits(count);
+    CacheCounters &counters = CacheCounters::local();
+    for(int group=1; group <= 32; group *= 2) {
+        double best = INFINITY;
+        uint64_t bestCycles = 0, bestMisses = 0;
+        for(int k=0; k < 3; ++k) {
+            uint64_t tests = 0, l1Before, llBefore, l1After, llAfter;
+            counters.read(l1Before, llBefore);
+            auto start = std::chrono::high_resolution_clock::now();
+            uint64_t cyclesBefore = cycles();
+            if (group == 1)
+                for(int r=0; r < count; ++r)
+                    plain[r] = bvh.trace(objects, rays[r], tests);
+            else
+                bvh.traceGroup(objects, rays.data(), hits.data(), count, group, tests);
+            uint64_t cyclesAfter = cycles();
+            std::chrono::duration<double> traced =
+                std::chrono::high_resolution_clock::now() - start;
+            counters.read(l1After, llAfter);
+            if (traced.count() < best) {
+                best = traced.count();
+                bestCycles = cyclesAfter - cyclesBefore;
+                bestMisses = llAfter - llBefore;
+            }
+        }
+
+        int same = count;
+        if (group > 1)
+            for(int r=0; r < count; ++r)
+                same -= hits[r].object() != plain[r].object() || hits[r].t != plain[r].t;
+
+        std::cout << (group == 1 ? std::string("plain") : "interleave " + std::to_string(group))
+            << ": " << 1e9 * best / count << " ns, " << double(bestCycles) / count
+            << " cycles";
+        if (counters.available())
+            std::cout << ", " << double(bestMisses) / count << " LLC misses";
+        std::cout << " per ray";
+        if (group > 1 && same != count)
+            std::cout << "; " << count - same << " hits differ";
+        std::cout << '\n';
+    }
+}
+
+// render in three passes, tracing pixels on a grid of every 4th pixel,
+// then the rest of every 2nd pixel, then the rest, so each is traced
+// once, just as for a normal render
+// after each pass, the whole image is written, with each pixel not yet
+// traced copied from the nearest traced one up and to the left; a file
+// is rewritten in place, stdout or a pipe gets a stream of images
+static int
+renderProgressive(World &world, const Job &job, const Camera &camera,
+                  const std::string &outname, FILE *output,
+                  std::unique_ptr<ThreadPool> &pool, Latency &latency)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    int tileSize = std::max(job.tileSize, 1);
+    Image::Format format = job.formatGiven ? job.format : Image::formatOf(outname.c_str());
+
+    Tile crop = jobRegion(world, job);
+    if (crop.width() <= 0 || crop.height() <= 0) {
+        std::cerr << "Empty crop window\n";
+        closeOutput(outname, output);
         return 1;
     }
+    TileList tiles = makeTiles(crop, tileSize, job.order);
+    Sampler sampler(world, camera);
 
-    // input file from command line or stdin
-    std::ifstream infile(filename);
-    if (!infile) {
-        std::cerr << "Error opening " << filename << '\n';
+    // traced pixels, and the upscaled preview written after each pass
+    Image image(crop.width(), crop.height()), preview(crop.width(), crop.height());
+    if (crop.width() != world.width || crop.height() != world.height) {
+        preview.x0 = crop.x0;
+        preview.y0 = crop.y0;
+        preview.fullWidth = world.width;
+        preview.fullHeight = world.height;
+    }
+
+    float writeTime = 0;
+    for(int step=4; step >= 1; step /= 2) {
+        auto passStart = std::chrono::high_resolution_clock::now();
+
+        // trace pixels on this pass's grid that weren't on the last one
+        std::atomic<int> pixels(0);
+        pool->run(int(tiles.size()), [&](int t, int) {
+            const Tile &tile = tiles[t];
+            int traced = 0;
+            for(int j=tile.y0; j < tile.y1; ++j) {
+                int y = j - crop.y0;
+                if (y % step) continue;
+                for(int i=tile.x0; i < tile.x1; ++i) {
+                    int x = i - crop.x0;
+                    if (x % step || (step < 4 && x % (2*step) == 0 && y % (2*step) == 0))
+                        continue;
+                    Vec3 col = sampler.pixel(i, j);
+                    float *out = image.at(x, y);
+                    out[0] = col[0]; out[1] = col[1]; out[2] = col[2];
+                    ++traced;
+                }
+            }
+            pixels += traced;
+        });
+        auto passEnd = std::chrono::high_resolution_clock::now();
+
+        // fill in the rest from the pixel at the start of its grid cell
+        const Image *result = &image;
+        if (step > 1) {
+            for(int y=0; y < preview.height; ++y)
+                for(int x=0; x < preview.width; ++x)
+                    memcpy(preview.at(x, y), image.at(x - x % step, y - y % step),
+                           3*sizeof(float));
+            result = &preview;
+        }
+
+        // a file is rewritten from the start, a stream can't seek
+        fseek(output, 0, SEEK_SET);
+        if (preview.fullWidth != preview.width || preview.fullHeight != preview.height)
+            Image::writeHeader(output, format, preview.width, preview.height,
+                               preview.x0, preview.y0, preview.fullWidth, preview.fullHeight);
+        else
+            Image::writeHeader(output, format, preview.width, preview.height);
+        Image::writeRows(output, format, result->pixels.data(), preview.width, preview.height);
+        fflush(output);
+        auto written = std::chrono::high_resolution_clock::now();
+
+        std::chrono::duration<float> traced = passEnd - passStart, wrote = written - passEnd;
+        writeTime += wrote.count();
+        std::cout << "pass 1/" << step*step << ": " << pixels << " pixels, "
+            << 1000*traced.count() << " ms trace, " << 1000*wrote.count() << " ms write\n";
+    }
+    auto traceTime = std::chrono::high_resolution_clock::now();
+    closeOutput(outname, output);
+
+    std::chrono::duration<float> traced = traceTime - startTime;
+    latency.trace = traced.count();
+    latency.write = writeTime;
+
+    Light::stats(std::cout);
+    if (world.samples > 1)
+        std::cout << Sampler::samplesPerPixel() << " Samples per pixel, of "
+            << world.samples*world.samples << '\n';
+    if (!job.compare.empty()) {
+        if (outname[0] == '|' || outname == "-")
+            std::cerr << "-compare needs a single file for output\n";
+        else
+            compareImages(outname.c_str(), job.compare.c_str());
+    }
+    return 0;
+}
+
+// hash for job's recorded hits: the scene without its colors, and the
+// options and view that change which rays are traced
+static uint64_t
+reshadeHash(const Job &job, const Camera &cam, const Tile &crop)
+{
+    std::ifstream scene(job.filename, std::ifstream::in | std::ifstream::binary);
+    std::string text((std::istreambuf_iterator<char>(scene)),
+                     std::istreambuf_iterator<char>());
+    std::ostringstream options;
+    options << World::effects << ' ' << Light::shadowSamples << ' ' << job.reshadeBounces
+        << ' ' << crop.x0 << ' ' << crop.y0 << ' ' << crop.x1 << ' ' << crop.y1 << ' '
+        << cam.xfov << ' ' << cam.yfov;
+    for(int i=0; i < 3; ++i)
+        options << ' ' << cam.eye[i] << ' ' << cam.look[i] << ' ' << cam.up[i];
+    return Checkpoint::fnv(options.str().data(), options.str().size(),
+                           ShadeCache::sceneHash(text));
+}
+
+// what an animation keeps from frame to frame to trace only the tiles
+// that can have changed
+struct Incremental {
+    std::unique_ptr<TileDeps> deps;     // made by the first frame
+    std::vector<Vec3> image;            // last frame's radiance over the crop
+    bool everything;                    // trace every tile, as for a new camera
+    std::vector<int> moved;             // objects moved since the last frame
+    int traced, tiles;                  // tiles traced in the last frame, of all
+
+    std::unique_ptr<TemporalCache> temporal;    // primary hits' shadows
+
+    Incremental() : everything(true), traced(0), tiles(0) {}
+};
+
+// render job with world, for each camera to the matching output, a file or
+// pipe already open
+// for an animation frame, if incremental is given, tiles it can't have
+// changed are kept from the frame before
+// tiles of all the views are interleaved, so neighboring views, which see
+// much the same part of the scene, are traced together
+// the pool is replaced if it doesn't have the threads or scratch needed
+static int
+render(World &world, const Job &job, const std::vector<Camera> &cameras,
+       const std::vector<std::string> &outnames, const std::vector<FILE*> &outputs,
+       std::unique_ptr<ThreadPool> &pool, Latency &latency, Incremental *incremental=0)
+{
+    // render threads, each with scratch space for one tile of colors
+    int tileSize = std::max(job.tileSize, 1);
+    preparePool(job, pool);
+
+    // acceleration structure, kept with a cached scene between server jobs
+    if (!world.objects.builtAs(job.accel, job.treelets))
+        world.objects.build(job.accel, job.treelets, pool.get());
+    if (job.buildBench)
+        benchBuild(world, job, pool->size());
+    if (job.traceBench)
+        benchTrace(world, job, cameras[0]);
+
+    auto startTime = std::chrono::high_resolution_clock::now();
+    int views = int(cameras.size());
+
+    if (job.progressive)
+        return renderProgressive(world, job, cameras[0], outnames[0], outputs[0],
+                                 pool, latency);
+
+    // region of the image to render
+    Tile crop = jobRegion(world, job);
+    if (crop.width() <= 0 || crop.height() <= 0) {
+        std::cerr << "Empty crop window\n";
+        for(int v=0; v < views; ++v)
+            closeOutput(outnames[v], outputs[v]);
         return 1;
     }
+    if (job.split > 1) {
+        // estimate the cost of each band of tiles by the intersection tests
+        // for a sparse grid of pixels in it; test counts, unlike times, come
+        // out the same in every process, so every part agrees on the split
+        Sampler sampler(world, cameras[0]);
+        int bands = (crop.height() + tileSize - 1) / tileSize;
+        int stride = std::max(1, tileSize/2);
+        std::vector<double> bandCost(bands);
+        pool->run(bands, [&](int b, int) {
+            uint64_t before = ObjectList::threadTests();
+            int y1 = std::min(crop.y0 + (b+1)*tileSize, crop.y1);
+            for(int j = crop.y0 + b*tileSize + stride/2; j < y1; j += stride)
+                for(int i = crop.x0 + stride/2; i < crop.x1; i += stride)
+                    sampler.pixel(i, j);
+            bandCost[b] = double(ObjectList::threadTests() - before);
+        });
+        crop = splitRegion(crop, bandCost, tileSize, job.split)[job.part];
+        std::cout << "part " << job.part << " of " << job.split << ": rows "
+            << crop.y0 << " to " << crop.y1 << '\n';
+    }
 
-    // image parameters, camera parameters
-    World world(infile);
+    // tiles of the region in traversal order, the same for every view
+    TileList tiles = makeTiles(crop, tileSize, job.order);
+
+    // rays for each pixel, and image data in file order, written a band of
+    // tiles at a time, for each view
+    std::vector<Sampler> samplers;
+    std::vector<std::unique_ptr<BandWriter> > writers;
+    for(int v=0; v < views; ++v) {
+        Image::Format format = job.formatGiven ? job.format
+                                               : Image::formatOf(outnames[v].c_str());
+        if (crop.width() == world.width && crop.height() == world.height)
+            Image::writeHeader(outputs[v], format, crop.width(), crop.height());
+        else
+            Image::writeHeader(outputs[v], format, crop.width(), crop.height(),
+                               crop.x0, crop.y0, world.width, world.height);
+        samplers.push_back(Sampler(world, cameras[v]));
+        writers.push_back(std::unique_ptr<BandWriter>(new BandWriter(
+            outputs[v], format, crop.width(), crop.height(), tileSize,
+            (crop.width() + tileSize - 1) / tileSize, job.window)));
+    }
 
-    // array of image data in ppm-file order
-    unsigned char (*pixels)[3] = new unsigned char[world.height*world.width][3];
-
-    // spawn a ray for each pixel and place the result in the pixel
-    std::vector<std::thread> threads;
-    for (int j=0; j<world.width; ++j) {
-        // spawn thread per line
-        // capture j by value since it'll change before/during thread execution
-        threads.push_back(std::thread([&, j]{
-            for(int i=0; i<world.width; ++i) {
-
-                // trace new ray
-                float us = world.left + (world.right  - world.left) * (i+0.5f)/world.width;
-                float vs = world.top  + (world.bottom - world.top ) * (j+0.5f)/world.height;
-                Vec3 dir = -world.dist * world.w + us * world.u + vs * world.v;
-
-                Ray ray(world.eye, dir, 1e-4, INFINITY, world.maxdepth, 1);
-                Intersection isect = world.objects.trace(ray);
-                Vec3 col = isect.color(world, ray);
-
-                // assign color
-                pixels[j*world.width + i][0] = col.r();
-                pixels[j*world.width + i][1] = col.g();
-                pixels[j*world.width + i][2] = col.b();
+    // checkpoint of finished tiles, next to the output, for a single view
+    std::unique_ptr<Checkpoint> checkpoint;
+    if (views == 1 && (job.checkpointInterval > 0 || job.resume)) {
+        // anything that changes the pixels or tiles changes the hash
+        const Camera &cam = cameras[0];
+        std::ifstream scene(job.filename, std::ifstream::in | std::ifstream::binary);
+        std::string text((std::istreambuf_iterator<char>(scene)),
+                         std::istreambuf_iterator<char>());
+        std::ostringstream options;
+        options << World::effects << ' ' << World::roulette << ' ' << World::pixelSamples
+            << ' ' << World::lightSamples << ' ' << World::contrast << ' '
+            << Light::shadowSamples << ' ' << tileSize << ' ' << job.accel << ' '
+            << crop.x0 << ' ' << crop.y0 << ' ' << crop.x1 << ' ' << crop.y1 << ' '
+            << cam.xfov << ' ' << cam.yfov;
+        for(int i=0; i < 3; ++i)
+            options << ' ' << cam.eye[i] << ' ' << cam.look[i] << ' ' << cam.up[i];
+        uint64_t hash = Checkpoint::fnv(text.data(), text.size());
+        hash = Checkpoint::fnv(options.str().data(), options.str().size(), hash);
+
+        bool named = outnames[0][0] != '|' && outnames[0] != "-";
+        checkpoint.reset(new Checkpoint((named ? outnames[0] : std::string("trace")) + ".ckpt",
+                                        hash, tiles, crop));
+        if (job.resume) {
+            int restored = checkpoint->resume();
+            if (restored < 0)
+                std::cout << "No matching checkpoint, rendering everything\n";
+            else
+                std::cout << "Resumed " << restored << " of " << tiles.size() << " tiles\n";
+        }
+        if (job.checkpointInterval > 0)
+            checkpoint->start(job.checkpointInterval);
+    }
+
+    // recorded hits to shade from, or to record for the next render
+    std::unique_ptr<ShadeCache> reshade;
+    if (!job.reshadeFile.empty()) {
+        if (world.samples > 1 || World::roulette > 0 || World::lightSamples > 0)
+            std::cout << "Recording hits needs one ray per pixel, rendering without\n";
+        else {
+            reshade.reset(new ShadeCache(job.reshadeFile, reshadeHash(job, cameras[0], crop),
+                                         crop, job.reshadeBounces,
+                                         size_t(job.reshadeLimit) << 20));
+            reshade->load();
+        }
+    }
+
+    // with a limited window, hand out tiles band by band so the oldest
+    // band always finishes, keeping the curve order within each band
+    // every view's writer has the same bands, so one order suits them all
+    BandWriter &first = *writers[0];
+    if (first.resident() * tileSize < crop.height())
+        std::stable_sort(tiles.begin(), tiles.end(), [&](const Tile &a, const Tile &b) {
+            return first.sequence(a.y0 - crop.y0) < first.sequence(b.y0 - crop.y0);
+        });
+
+    // tiles to trace again, the rest coming from the frame before; the
+    // tile order is the same every frame, so tiles are numbered by it
+    std::vector<char> redo(tiles.size(), 1);
+    TileDeps *deps = 0;
+    if (incremental && job.incremental) {
+        if (!incremental->deps) {
+            incremental->deps.reset(new TileDeps(world, int(tiles.size())));
+            incremental->image.assign(size_t(crop.width()) * crop.height(), Vec3());
+            incremental->everything = true;
+        }
+        else if (!incremental->everything)
+            incremental->deps->edit(world.objects, incremental->moved);
+        incremental->tiles = int(tiles.size());
+        incremental->traced = 0;
+        for(int t=0; t < int(tiles.size()); ++t) {
+            redo[t] = incremental->everything || incremental->deps->dirty(t);
+            incremental->traced += redo[t];
+        }
+        deps = incremental->deps.get();
+    }
+
+    // shadows of the last frame's primary hits, while nothing has moved
+    TemporalCache *temporal = 0;
+    if (incremental && job.temporal > 0) {
+        if (world.samples > 1 || World::roulette > 0 || World::lightSamples > 0)
+            std::cout << "Reusing shadows needs one ray per pixel and every light, "
+                "rendering without\n";
+        else {
+            if (!incremental->temporal)
+                incremental->temporal.reset(new TemporalCache(world, crop, job.temporal));
+            temporal = incremental->temporal.get();
+            temporal->frame(View(cameras[0]), incremental->moved.empty());
+        }
+    }
+
+    // spawn rays for each pixel of each tile and place the results in pixels
+    // work item k is tile k/views of view k%views
+    int items = int(tiles.size()) * views;
+    std::atomic<int> tilesDone(0);
+
+    // quality levels for a deadline, counting only tiles still to trace
+    std::unique_ptr<Budget> budget;
+    std::vector<int> tileLevels(items, 0);
+    if (job.budget > 0) {
+        long long pixels = 0;
+        for(int t=0; t < int(tiles.size()); ++t)
+            if (!(checkpoint && checkpoint->isDone(t)))
+                pixels += (long long)tiles[t].width() * tiles[t].height() * views;
+        budget.reset(new Budget(world, job.budget, latency.start, LastWrite,
+                                int(pool->size()), pixels));
+    }
+
+    std::atomic<uint64_t> l1Misses(0), llMisses(0);
+    pool->run(items, [&](int k, int thread) {
+        int t = k / views, view = k % views;
+        const Tile &tile = tiles[t];
+        const Sampler &sampler = samplers[view];
+        BandWriter &writer = *writers[view];
+        Vec3 *scratch = (Vec3*)pool->scratch(thread);
+        int tileWidth = tile.x1 - tile.x0;
+
+        uint64_t l1Before = 0, llBefore = 0;
+        if (job.cacheStats)
+            CacheCounters::local().read(l1Before, llBefore);
+
+        // quality for this tile, if on a budget
+        bool restored = checkpoint && checkpoint->isDone(t);
+        bool reused = !redo[t];
+        int level = 0;
+        Quality quality(world);
+        auto tileStart = std::chrono::high_resolution_clock::now();
+        if (budget && !restored) {
+            level = budget->choose(tile.width() * tile.height());
+            if (budget->traced(level))
+                quality = budget->settings(level);
+        }
+        tileLevels[k] = restored ? -1 : level;
+
+        // trace rays for this tile, unless it was in the checkpoint or is
+        // unchanged since the last frame
+        if (deps && !reused)
+            deps->begin(t);
+        if (!restored && !reused && !(budget && !budget->traced(level)) &&
+            job.interleave > 1 && !reshade && !temporal)
+            sampler.block(tile.x0, tile.y0, tile.x1, tile.y1, quality, job.interleave,
+                          job.batchShade, scratch);
+        else {
+            for(int j=tile.y0; j < tile.y1; ++j) {
+                for(int i=tile.x0; i < tile.x1; ++i) {
+                    if (restored) {
+                        const float *col = checkpoint->at(i, j);
+                        scratch[(j - tile.y0)*tileWidth + i - tile.x0] = Vec3(col[0], col[1], col[2]);
+                    }
+                    else if (reused)
+                        scratch[(j - tile.y0)*tileWidth + i - tile.x0] =
+                            incremental->image[(j - crop.y0)*crop.width() + i - crop.x0];
+                    else if (budget && !budget->traced(level))
+                        scratch[(j - tile.y0)*tileWidth + i - tile.x0] = world.background;
+                    else if (temporal)
+                        scratch[(j - tile.y0)*tileWidth + i - tile.x0] =
+                            sampler.reproject(i, j, quality, *temporal);
+                    else if (reshade) {
+                        ShadePath &path = reshade->at(i, j);
+                        Vec3 &col = scratch[(j - tile.y0)*tileWidth + i - tile.x0];
+                        if (reshade->replaying())
+                            col = path.complete ? path.color(world) : sampler.pixel(i, j, quality);
+                        else {
+                            col = sampler.record(i, j, quality, job.reshadeBounces, path);
+                            reshade->finish(path);
+                        }
+                    }
+                    else
+                        scratch[(j - tile.y0)*tileWidth + i - tile.x0] = sampler.pixel(i, j, quality);
+                }
+            }
+        }
+        if (deps && !reused) {
+            TileDeps::end();
+            for(int j=tile.y0; j < tile.y1; ++j)
+                for(int i=tile.x0; i < tile.x1; ++i)
+                    incremental->image[(j - crop.y0)*crop.width() + i - crop.x0] =
+                        scratch[(j - tile.y0)*tileWidth + i - tile.x0];
+        }
+        if (budget && !restored) {
+            std::chrono::duration<float> tileTime =
+                std::chrono::high_resolution_clock::now() - tileStart;
+            budget->finish(level, tile.width() * tile.height(), tileTime.count());
+        }
+
+        if (job.cacheStats) {
+            uint64_t l1After, llAfter;
+            CacheCounters::local().read(l1After, llAfter);
+            l1Misses += l1After - l1Before;
+            llMisses += llAfter - llBefore;
+        }
+
+        // assign colors, still in radiance
+        float (*pixels)[3] = writer.row(tile.y0 - crop.y0);
+        for(int j=tile.y0; j < tile.y1; ++j) {
+            for(int i=tile.x0; i < tile.x1; ++i) {
+                const Vec3 &col = scratch[(j - tile.y0)*tileWidth + i - tile.x0];
+                pixels[(j - tile.y0)*crop.width() + i - crop.x0][0] = col[0];
+                pixels[(j - tile.y0)*crop.width() + i - crop.x0][1] = col[1];
+                pixels[(j - tile.y0)*crop.width() + i - crop.x0][2] = col[2];
+            }
+        }
+        writer.tileDone(tile.y0 - crop.y0);
+
+        // hand a copy to the checkpoint, only at full quality, so a resumed
+        // render without the deadline doesn't keep degraded tiles
+        if (checkpoint && !restored && level == 0) {
+            for(int j=tile.y0; j < tile.y1; ++j) {
+                for(int i=tile.x0; i < tile.x1; ++i) {
+                    const Vec3 &col = scratch[(j - tile.y0)*tileWidth + i - tile.x0];
+                    float *saved = checkpoint->at(i, j);
+                    saved[0] = col[0]; saved[1] = col[1]; saved[2] = col[2];
+                }
             }
+            checkpoint->finish(t);
+        }
+
+        // some measure of progress on tile *completion*
+        int done = ++tilesDone;
+        if (done % 64 == 0)
+            std::cout << "tile " << done << " of " << items << '\n';
+    });
+    auto traceTime = std::chrono::high_resolution_clock::now();
+
+    // every band has been written
+    float writeTime = 0;
+    for(int v=0; v < views; ++v) {
+        writeTime += writers[v]->writeSeconds();
+        closeOutput(outnames[v], outputs[v]);
+    }
+    auto closeTime = std::chrono::high_resolution_clock::now();
 
-            // some measure of progress on line *completion*
-            if (j % 32 == 0) std::cout << "line " << j << '\n';
-        }));
+    std::chrono::duration<float> traced = traceTime - startTime, closed = closeTime - traceTime;
+    latency.trace = traced.count();
+    latency.write = writeTime + closed.count();
+    LastWrite = latency.write;
+    if (views > 1)
+        std::cout << views << " views, " << 1000 * latency.trace / views << " ms each\n";
+    if (budget)
+        budget->stats(std::cout, tiles, tileLevels, views, crop, tileSize);
 
-        // Not exactly the same as not having any parallel code, but simulate
-        // no parallelism by joining each thread immediately
-        if (!(World::effects & World::PARALLEL))
-            threads.back().join();
+    // hits recorded this time are kept for the next
+    if (reshade) {
+        if (!reshade->replaying() && !reshade->save())
+            std::cerr << "Error writing " << job.reshadeFile << '\n';
+        reshade->stats(std::cout);
     }
 
-    if ((World::effects & World::PARALLEL)) {
-        for (auto &thread : threads) thread.join();
+    if (temporal)
+        temporal->stats(std::cout);
+
+    // the render is complete, so the checkpoint is no longer needed
+    if (checkpoint) {
+        checkpoint->stop();
+        checkpoint->remove();
+        checkpoint->stats(std::cout);
     }
 
-    // write ppm file of pixels
-    std::ofstream output("trace.ppm", std::ofstream::out | std::ofstream::binary);
-    output << "P6\n" << world.width << ' ' << world.height << '\n' << 255 << '\n';
-    output.write((const char *)(pixels), world.height*world.width*3);
+    if (job.cacheStats) {
+        if (CacheCounters::local().available())
+            std::cout << l1Misses << " L1D read misses; "
+                << llMisses << " LLC read misses\n";
+        else
+            std::cout << "Cache counters unavailable on this system\n";
+    }
 
-    delete[] pixels;
+    Light::stats(std::cout);
+    if (world.samples > 1)
+        std::cout << Sampler::samplesPerPixel() << " Samples per pixel, of "
+            << world.samples*world.samples << '\n';
+
+    if (!job.compare.empty()) {
+        if (views > 1 || outnames[0][0] == '|' || outnames[0] == "-")
+            std::cerr << "-compare needs a single file for output\n";
+        else
+            compareImages(outnames[0].c_str(), job.compare.c_str());
+    }
+    return 0;
+}
+
+// open an output for each name, closing them all on failure
+// returns the name that failed, or an empty string
+static std::string
+openOutputs(const std::vector<std::string> &names, std::vector<FILE*> &outputs)
+{
+    outputs.clear();
+    for(auto &name : names) {
+        FILE *out = openOutput(name.c_str());
+        if (!out) {
+            for(size_t v=0; v < outputs.size(); ++v)
+                closeOutput(names[v], outputs[v]);
+            outputs.clear();
+            return name;
+        }
+        outputs.push_back(out);
+    }
+    return std::string();
+}
+
+// render each frame of job's animation, moving objects and camera first
+// the acceleration structure is refit to what moved, or rebuilt once that
+// has made it too slow, and the same pool traces every frame
+static int
+animate(World &world, const Job &job)
+{
+    std::ifstream in(job.framesFile);
+    Animation animation;
+    if (!in || !animation.read(in, int(world.objects.objects.size()))) {
+        std::cerr << "Error reading frames from " << job.framesFile << '\n';
+        return 1;
+    }
+    int frames = int(animation.frames.size());
+    std::vector<std::string> names = outputNames(job, frames);
+
+    std::unique_ptr<ThreadPool> pool;
+    preparePool(job, pool);
+    world.objects.build(job.accel, job.treelets, pool.get());
+    float updateTotal = 0, traceTotal = 0;
+    int rebuilds = 0;
+    Incremental incremental;
+    for(int f=0; f < frames; ++f) {
+        // move things, and bring the acceleration structure up to date
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        std::vector<int> moved;
+        animation.apply(f, world, moved);
+        bool rebuilt = world.objects.update(moved, job.refitLimit, pool.get());
+        std::chrono::duration<float> update =
+            std::chrono::high_resolution_clock::now() - frameStart;
+
+        // a new camera sees everything differently
+        const Animation::Frame &frame = animation.frames[f];
+        incremental.everything = frame.setEye || frame.setLook || frame.setUp || frame.setFov;
+        incremental.moved = moved;
+
+        std::vector<Camera> cameras;
+        jobCameras(world, job, cameras);
+        std::vector<std::string> outnames(1, names[f]);
+        std::vector<FILE*> outputs;
+        if (!openOutputs(outnames, outputs).empty()) {
+            std::cerr << "Error opening " << names[f] << '\n';
+            return 1;
+        }
+        Latency latency;
+        int status = render(world, job, cameras, outnames, outputs, pool, latency,
+                            job.incremental || job.temporal > 0 ? &incremental : 0);
+        if (status != 0) return status;
+
+        std::cout << "frame " << f << ": " << moved.size() << " moved, "
+            << (rebuilt ? "rebuild " : "refit ") << 1000 * update.count()
+            << " ms (cost " << world.objects.costGrowth() << "x as built), trace "
+            << 1000 * latency.trace << " ms";
+        if (job.incremental)
+            std::cout << ", " << incremental.traced << " of " << incremental.tiles << " tiles";
+        std::cout << '\n';
+        updateTotal += update.count();
+        traceTotal += latency.trace;
+        rebuilds += rebuilt;
+    }
+    std::cout << frames << " frames, average update " << 1000 * updateTotal / frames
+        << " ms, trace " << 1000 * traceTotal / frames << " ms; " << rebuilds
+        << " rebuild" << (rebuilds == 1 ? "" : "s") << '\n';
+    if (incremental.deps)
+        std::cout << "Tile dependencies " << incremental.deps->bytes() / (1024*1024.)
+            << " MB\n";
+    return 0;
+}
+
+// parsed scenes kept by a server, by file name
+// reused while the file's modification time and the object types it was
+// parsed with are unchanged
+class SceneCache {
+private: // private data
+    struct Entry {
+        time_t mtime;
+        unsigned int shapes;        // World::POLYGONS and SPHERES when parsed
+        std::unique_ptr<World> world;
+    };
+    std::map<std::string, Entry> scenes;
+
+public: // computational members
+    // world for filename, parsing it if needed, or null if it can't be read
+    // sets hit to whether it was already parsed
+    World *lookup(const std::string &filename, bool &hit) {
+        hit = false;
+        struct stat info;
+        if (stat(filename.c_str(), &info) != 0) return nullptr;
+
+        unsigned int shapes = World::effects & (World::POLYGONS | World::SPHERES);
+        Entry &entry = scenes[filename];
+        if (entry.world && entry.mtime == info.st_mtime && entry.shapes == shapes) {
+            hit = true;
+            return entry.world.get();
+        }
+
+        std::ifstream infile(filename);
+        if (!infile) {
+            scenes.erase(filename);
+            return nullptr;
+        }
+        entry.world.reset(new World(infile));
+        entry.mtime = info.st_mtime;
+        entry.shapes = shapes;
+        return entry.world.get();
+    }
+};
+
+// run one server job line, returning the reply
+static std::string
+serveJob(const std::string &line, const Job &defaults, const Settings &settings,
+         SceneCache &cache, std::unique_ptr<ThreadPool> &pool, int number)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+    std::ostringstream reply;
+    reply << "job " << number << ": ";
+
+    // split line into arguments, parsed over the server's own options
+    std::istringstream words(line);
+    std::vector<std::string> args;
+    for(std::string word; words >> word; )
+        args.push_back(word);
+    std::vector<char*> argv;
+    for(auto &a : args)
+        argv.push_back(&a[0]);
+
+    settings.restore();
+    Job job = defaults;
+    job.server.clear();
+    job.filename.clear();
+    if (!parseJob(int(argv.size()), argv.data(), job) || job.filename.empty()) {
+        reply << "error: bad options";
+        return reply.str();
+    }
+    if (job.outname == "-") {
+        reply << "error: server output can't go to stdout";
+        return reply.str();
+    }
+    if (!job.framesFile.empty()) {
+        reply << "error: animations aren't served";
+        return reply.str();
+    }
+    if (!job.pageFile.empty()) {
+        reply << "error: paged scenes aren't served";
+        return reply.str();
+    }
+
+    bool hit;
+    World *world = cache.lookup(job.filename, hit);
+    auto lookupTime = std::chrono::high_resolution_clock::now();
+    if (!world) {
+        reply << "error: can't read " << job.filename;
+        return reply.str();
+    }
+
+    std::vector<Camera> cameras;
+    if (!jobCameras(*world, job, cameras)) {
+        reply << "error: can't read cameras from " << job.cameraFile;
+        return reply.str();
+    }
+    std::vector<std::string> outnames = outputNames(job, int(cameras.size()));
+    std::vector<FILE*> outputs;
+    std::string failed = openOutputs(outnames, outputs);
+    if (!failed.empty()) {
+        reply << "error: can't open " << failed;
+        return reply.str();
+    }
+
+    Latency latency;
+    latency.start = startTime;
+    std::chrono::duration<float> lookup = lookupTime - startTime;
+    latency.lookup = lookup.count();
+    if (render(*world, job, cameras, outnames, outputs, pool, latency) != 0) {
+        reply << "error: render failed";
+        return reply.str();
+    }
 
     auto endTime = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<float> elapsed = endTime - startTime;
-    std::cout << elapsed.count() << " seconds\n";
+    std::chrono::duration<float> total = endTime - startTime;
+    reply << outnames[0];
+    if (outnames.size() > 1)
+        reply << " (" << outnames.size() << " views)";
+    reply << " lookup " << 1000*latency.lookup << " ms ("
+        << (hit ? "cached" : "parsed") << "), trace " << 1000*latency.trace
+        << " ms, write " << 1000*latency.write << " ms, total "
+        << 1000*total.count() << " ms";
+    return reply.str();
+}
+
+// serve jobs a line at a time from stdin or a UNIX socket
+// a line of "quit" stops the server
+static int
+serve(const Job &defaults)
+{
+    Settings settings;
+    SceneCache cache;
+    std::unique_ptr<ThreadPool> pool;
+    int jobs = 0;
+
+    if (defaults.server == "-") {
+        for(std::string line; std::getline(std::cin, line); ) {
+            if (line == "quit") break;
+            if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '#')
+                continue;
+            std::string reply = serveJob(line, defaults, settings, cache, pool, ++jobs);
+            std::cout << reply << std::endl;
+        }
+        return 0;
+    }
+
+#ifdef _WIN32
+    std::cerr << "Socket server not supported on Windows, use -server -\n";
+    return 1;
+#else
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (listener < 0 || defaults.server.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Can't create socket " << defaults.server << '\n';
+        return 1;
+    }
+    strcpy(addr.sun_path, defaults.server.c_str());
+    unlink(addr.sun_path);
+    if (bind(listener, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(listener, 4) != 0) {
+        std::cerr << "Can't listen on " << defaults.server << '\n';
+        return 1;
+    }
+    std::cout << "Serving on " << defaults.server << std::endl;
+
+    // one connection at a time, each sending any number of job lines
+    bool quit = false;
+    while (!quit) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        FILE *in = fdopen(fd, "r"), *out = fdopen(dup(fd), "w");
+        char buffer[4096];
+        while (in && out && fgets(buffer, sizeof(buffer), in)) {
+            std::string line(buffer);
+            line.erase(line.find_last_not_of("\r\n") + 1);
+            if (line == "quit") {
+                quit = true;
+                break;
+            }
+            if (line.find_first_not_of(" \t") == std::string::npos || line[0] == '#')
+                continue;
+            std::string reply = serveJob(line, defaults, settings, cache, pool, ++jobs);
+            std::cout << reply << std::endl;
+            fprintf(out, "%s\n", reply.c_str());
+            fflush(out);
+        }
+        if (in) fclose(in);
+        if (out) fclose(out);
+    }
+    close(listener);
+    unlink(addr.sun_path);
     return 0;
+#endif
+}
+
+// whether job's page file is at least as new as its scene, whole, and
+// written with the same object types, so the scene's spheres and polygons
+// needn't be parsed again, opening pager on it if so
+static bool
+pagesCurrent(const Job &job, Pager &pager)
+{
+    struct stat scene, pages;
+    return stat(job.filename.c_str(), &scene) == 0 &&
+        stat(job.pageFile.c_str(), &pages) == 0 && pages.st_mtime >= scene.st_mtime &&
+        pager.open(job.pageFile, size_t(job.pageCache) << 20) &&
+        pager.shapes() == (World::effects & (World::POLYGONS | World::SPHERES));
+}
+
+// replace world's objects by clusters paged in from job's page file,
+// writing it from them and opening pager on it first unless current is set
+static bool
+pageScene(World &world, const Job &job, bool current, Pager &pager)
+{
+    if (!current) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        if (!Pager::write(job.pageFile, world.objects.objects, 256,
+                          World::effects & (World::POLYGONS | World::SPHERES))) {
+            std::cerr << "Error writing " << job.pageFile << '\n';
+            return false;
+        }
+        std::chrono::duration<float> elapsed =
+            std::chrono::high_resolution_clock::now() - startTime;
+        std::cout << "Wrote " << job.pageFile << " in " << elapsed.count() << " seconds\n";
+        if (!pager.open(job.pageFile, size_t(job.pageCache) << 20)) {
+            std::cerr << "Error reading " << job.pageFile << '\n';
+            return false;
+        }
+    }
+    world.objects.clear();
+    pager.addClusters(world.objects);
+    return true;
 }
 
+int main(int argc, char **argv)
+{
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    // parse command line arguments
+    Job job;
+    if (!parseJob(argc-1, argv+1, job) || (job.filename.empty() && job.server.empty())) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!job.server.empty())
+        return serve(job);
+
+    // input file from command line or stdin
+    std::ifstream infile(job.filename);
+    if (!infile) {
+        std::cerr << "Error opening " << job.filename << '\n';
+        return 1;
+    }
+
+    // image to stdout, opened first so messages go to stderr
+    std::vector<FILE*> outputs;
+    if (job.outname == "-") {
+        FILE *out = openOutput("-");
+        if (!out) {
+            std::cerr << "Error opening stdout\n";
+            return 1;
+        }
+        outputs.push_back(out);
+    }
+
+    // parse the intput into everything we know about the world
+    // image parameters, camera parameters
+    // with a current page file, its spheres and polygons are skipped
+    Pager pager;
+    bool paged = !job.pageFile.empty(), current = paged && pagesCurrent(job, pager);
+    unsigned int effects = World::effects;
+    if (current)
+        World::effects &= ~(World::POLYGONS | World::SPHERES);
+    World world(infile);
+    World::effects = effects;
+    if (paged && !pageScene(world, job, current, pager))
+        return 1;
+
+    if (!job.framesFile.empty()) {
+        int status = animate(world, job);
+        std::chrono::duration<float> elapsed =
+            std::chrono::high_resolution_clock::now() - startTime;
+        std::cout << elapsed.count() << " seconds\n";
+        return status;
+    }
+
+    // views and their outputs
+    std::vector<Camera> cameras;
+    if (!jobCameras(world, job, cameras)) {
+        std::cerr << "Error reading cameras from " << job.cameraFile << '\n';
+        return 1;
+    }
+    std::vector<std::string> outnames = outputNames(job, int(cameras.size()));
+    if (outputs.empty()) {
+        std::string failed = openOutputs(outnames, outputs);
+        if (!failed.empty()) {
+            std::cerr << "Error opening " << failed << '\n';
+            return 1;
+        }
+    }
+
+    std::unique_ptr<ThreadPool> pool;
+    Latency latency;
+    latency.start = startTime;
+    int status = render(world, job, cameras, outnames, outputs, pool, latency);
+    if (paged)
+        pager.stats(std::cout);
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<float> elapsed = endTime - startTime;
+    std::cout << elapsed.count() << " seconds\n";
+    return status;
+}
@@ -5,106 +5,94 @@
 #include <map>
 #include <cmath>
 
+#include "float4.hpp"
+
 using namespace std;
 
 const float epsilon = .01;
 
-class Color{
+class Color : public float4{
 
 	public:
 
-	float r;
-	float g;
-	float b;
+	Color(){}
 
-	Color(){
-		r = 0;
-		b = 0;
-		g = 0;
-	}
+	Color(float r, float g, float b): float4(r, g, b){}
 
-	Color(float r, float g, float b): r(r), g(g), b(b){}
+	explicit Color(const float4& v): float4(v){}
 
 	// Vector addition
 	Color operator+(Color color){
 
-		return Color(r + color.r, g + color.g, b + color.b);
+		return Color(static_cast<float4&>(*this) + color);
 
 	}
 
 	// Vector scalar multiplication
 	Color operator*(float scalar){
 
-		return Color(r * scalar, g * scalar, b * scalar);
+		return Color(static_cast<float4&>(*this) * scalar);
 
 	}
 
 };
 
 // Vector in 3d space
-class Vector3D{
+class Vector3D : public float4{
 	public:
 
-	float x;
-	float y;
-	float z;
-
-	Vector3D(){
+	Vector3D(){}
 
-		x = 0;
-		y = 0;
-		z = 0;
-
-	}
+	Vector3D(float x, float y, float z): float4(x, y, z){}
 
-	Vector3D(float x, float y, float z): x(x), y(y), z(z){}
+	explicit Vector3D(const float4& v): float4(v){}
 
 	// Vector addition
 	Vector3D operator+(Vector3D vec){
 
-		return Vector3D(x + vec.x, y + vec.y, z + vec.z);
+		return Vector3D(static_cast<float4&>(*this) + vec);
 
 	}
 
 	// Vector subtraction
 	Vector3D operator-(Vector3D vec){
 
-		return Vector3D(x - vec.x, y - vec.y, z - vec.z);
+		return Vector3D(static_cast<float4&>(*this) - vec);
 
 	}
 
 	// Vector scalar multiplication
 	Vector3D operator*(float scalar){
 
-		return Vector3D(x * scalar, y * scalar, z * scalar);
+		return Vector3D(static_cast<float4&>(*this) * scalar);
 
 	}
 
 	// Calculate vector length
 	float length(){
 
-		return sqrt(pow(x, 2) + pow(y, 2) + pow(z, 2));
+		return sqrtf(dot3(*this, *this));
 
 	}
 
 	// Calculation normalization of vector
 	Vector3D normalization(){
 
-		return Vector3D(x / length(), y / length(), z / length());
+		return Vector3D(normalize3(*this));
 
 	}
 
 	// Calculate cross product of two vectors
 	Vector3D crossProduct(Vector3D vec){
 
-		return Vector3D(y * vec.z - z * vec.y, z * vec.x - x * vec.z, x * vec.y - y * vec.x);
+		return Vector3D(cross3(*this, vec));
 
 	}
 
 	// Calculate dot product of two vectors
 	float dotProduct(Vector3D vec){
 
-		return x * vec.x + y * vec.y + z * vec.z;
+		return dot3(*this, vec);
 
 	}
 
@@ -0,0 +1,245 @@
+// 4-wide float vector shared by the ray tracers
+// uses SSE on x86, NEON on ARM, and plain floats everywhere else
+#ifndef FLOAT4_HPP
+#define FLOAT4_HPP
+
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FLOAT4_SSE 1
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#if defined(__FMA__)
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FLOAT4_NEON 1
+#include <arm_neon.h>
+#endif
+
+#ifdef _WIN32
+// anonymous structs inside the union are intentional
+#pragma warning( disable: 4201 )
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// 16-byte aligned x,y,z,w vector
+// 3D operations (dot3, cross3, normalize3) ignore and zero w
+struct alignas(16) float4 {
+    union {
+#if FLOAT4_SSE
+        __m128 m;
+#elif FLOAT4_NEON
+        float32x4_t m;
+#endif
+        float f[4];
+        struct { float x, y, z, w; };
+        struct { float r, g, b, a; };
+    };
+
+public: // constructors
+    float4() { set(0, 0, 0, 0); }
+    float4(float _x, float _y, float _z, float _w=0) { set(_x, _y, _z, _w); }
+#if FLOAT4_SSE || FLOAT4_NEON
+#if FLOAT4_SSE
+    typedef __m128 native;
+#else
+    typedef float32x4_t native;
+#endif
+    explicit float4(native _m) { m = _m; }
+#endif
+    // also can use default copy constructor
+
+    // splat one value across all four lanes
+    static float4 splat(float s) {
+#if FLOAT4_SSE
+        return float4(_mm_set1_ps(s));
+#elif FLOAT4_NEON
+        return float4(vdupq_n_f32(s));
+#else
+        return float4(s, s, s, s);
+#endif
+    }
+
+public:
+    void set(float _x, float _y, float _z, float _w) {
+#if FLOAT4_SSE
+        m = _mm_setr_ps(_x, _y, _z, _w);
+#else
+        f[0] = _x; f[1] = _y; f[2] = _z; f[3] = _w;
+#endif
+    }
+
+    float operator[](int i) const { return f[i]; }
+    float &operator[](int i) { return f[i]; }
+};
+
+//////////////////////////////
+// component-wise operations: -v, v1+v2, v1-v2, v1*v2, v1/v2, min, max, fma
+// operations with a scalar: s*v, v*s
+// 3D operations: dot3, cross3, rsqrt, normalize3
+
+inline float4 operator+(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    return float4(_mm_add_ps(v1.m, v2.m));
+#elif FLOAT4_NEON
+    return float4(vaddq_f32(v1.m, v2.m));
+#else
+    return float4(v1.f[0]+v2.f[0], v1.f[1]+v2.f[1], v1.f[2]+v2.f[2], v1.f[3]+v2.f[3]);
+#endif
+}
+
+inline float4 operator-(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    return float4(_mm_sub_ps(v1.m, v2.m));
+#elif FLOAT4_NEON
+    return float4(vsubq_f32(v1.m, v2.m));
+#else
+    return float4(v1.f[0]-v2.f[0], v1.f[1]-v2.f[1], v1.f[2]-v2.f[2], v1.f[3]-v2.f[3]);
+#endif
+}
+
+inline float4 operator*(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    return float4(_mm_mul_ps(v1.m, v2.m));
+#elif FLOAT4_NEON
+    return float4(vmulq_f32(v1.m, v2.m));
+#else
+    return float4(v1.f[0]*v2.f[0], v1.f[1]*v2.f[1], v1.f[2]*v2.f[2], v1.f[3]*v2.f[3]);
+#endif
+}
+
+inline float4 operator/(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    return float4(_mm_div_ps(v1.m, v2.m));
+#elif FLOAT4_NEON && defined(__aarch64__)
+    return float4(vdivq_f32(v1.m, v2.m));
+#else
+    return float4(v1.f[0]/v2.f[0], v1.f[1]/v2.f[1], v1.f[2]/v2.f[2], v1.f[3]/v2.f[3]);
+#endif
+}
+
+inline float4 operator-(const float4 &v) {
+#if FLOAT4_SSE
+    return float4(_mm_sub_ps(_mm_setzero_ps(), v.m));
+#elif FLOAT4_NEON
+    return float4(vnegq_f32(v.m));
+#else
+    return float4(-v.f[0], -v.f[1], -v.f[2], -v.f[3]);
+#endif
+}
+
+inline float4 operator*(float s, const float4 &v) { return float4::splat(s) * v; }
+inline float4 operator*(const float4 &v, float s) { return v * float4::splat(s); }
+
+// component-wise minimum and maximum
+inline float4 min(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    return float4(_mm_min_ps(v1.m, v2.m));
+#elif FLOAT4_NEON
+    return float4(vminq_f32(v1.m, v2.m));
+#else
+    return float4(fminf(v1.f[0], v2.f[0]), fminf(v1.f[1], v2.f[1]),
+                  fminf(v1.f[2], v2.f[2]), fminf(v1.f[3], v2.f[3]));
+#endif
+}
+
+inline float4 max(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    return float4(_mm_max_ps(v1.m, v2.m));
+#elif FLOAT4_NEON
+    return float4(vmaxq_f32(v1.m, v2.m));
+#else
+    return float4(fmaxf(v1.f[0], v2.f[0]), fmaxf(v1.f[1], v2.f[1]),
+                  fmaxf(v1.f[2], v2.f[2]), fmaxf(v1.f[3], v2.f[3]));
+#endif
+}
+
+// fused multiply-add, a*b + c
+// single rounding when the hardware has it, separate multiply and add otherwise
+inline float4 fma(const float4 &a, const float4 &b, const float4 &c) {
+#if FLOAT4_SSE && defined(__FMA__)
+    return float4(_mm_fmadd_ps(a.m, b.m, c.m));
+#elif FLOAT4_NEON && defined(__aarch64__)
+    return float4(vfmaq_f32(c.m, a.m, b.m));
+#else
+    return a*b + c;
+#endif
+}
+
+// 3D dot product, ignoring w, broadcast to all four lanes
+// keeps the result in a register for further vector math
+inline float4 dot3v(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    __m128 p = _mm_mul_ps(v1.m, v2.m);
+    __m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(0,0,0,0));
+    __m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1,1,1,1));
+    __m128 z = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2,2,2,2));
+    return float4(_mm_add_ps(_mm_add_ps(x, y), z));
+#elif FLOAT4_NEON && defined(__aarch64__)
+    float32x4_t p = vmulq_f32(v1.m, v2.m);
+    return float4(vaddq_f32(vaddq_f32(vdupq_laneq_f32(p, 0), vdupq_laneq_f32(p, 1)),
+                            vdupq_laneq_f32(p, 2)));
+#else
+    return float4::splat(v1.f[0]*v2.f[0] + v1.f[1]*v2.f[1] + v1.f[2]*v2.f[2]);
+#endif
+}
+
+// 3D dot product, ignoring w
+inline float dot3(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    return _mm_cvtss_f32(dot3v(v1, v2).m);
+#else
+    return v1.f[0]*v2.f[0] + v1.f[1]*v2.f[1] + v1.f[2]*v2.f[2];
+#endif
+}
+
+// 3D cross product, w of result is 0
+inline float4 cross3(const float4 &v1, const float4 &v2) {
+#if FLOAT4_SSE
+    // yzx shuffles: v1 x v2 = (v1 * v2.yzx - v1.yzx * v2).yzx
+    __m128 a = _mm_shuffle_ps(v1.m, v1.m, _MM_SHUFFLE(3,0,2,1));
+    __m128 b = _mm_shuffle_ps(v2.m, v2.m, _MM_SHUFFLE(3,0,2,1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(v1.m, b), _mm_mul_ps(a, v2.m));
+    return float4(_mm_shuffle_ps(c, c, _MM_SHUFFLE(3,0,2,1)));
+#else
+    return float4(v1.f[1]*v2.f[2] - v1.f[2]*v2.f[1],
+                  v1.f[2]*v2.f[0] - v1.f[0]*v2.f[2],
+                  v1.f[0]*v2.f[1] - v1.f[1]*v2.f[0]);
+#endif
+}
+
+// approximate 1/sqrt(v) per lane, hardware estimate refined with one Newton step
+// about 22 bits of precision, vs 12 for the raw estimate
+inline float4 rsqrt(const float4 &v) {
+#if FLOAT4_SSE
+    __m128 y = _mm_rsqrt_ps(v.m);
+    // y' = y * (1.5 - 0.5*x*y*y)
+    __m128 hxyy = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), v.m), _mm_mul_ps(y, y));
+    return float4(_mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), hxyy)));
+#elif FLOAT4_NEON
+    float32x4_t y = vrsqrteq_f32(v.m);
+    // vrsqrts computes (3 - a*b)/2, the Newton step factor
+    return float4(vmulq_f32(y, vrsqrtsq_f32(vmulq_f32(v.m, y), y)));
+#else
+    return float4(1/sqrtf(v.f[0]), 1/sqrtf(v.f[1]), 1/sqrtf(v.f[2]), 1/sqrtf(v.f[3]));
+#endif
+}
+
+inline float rsqrt(float s) {
+    return rsqrt(float4::splat(s)).f[0];
+}
+
+// normalize x,y,z using rsqrt, w of result is 0
+inline float4 normalize3(const float4 &v) {
+#if FLOAT4_SSE
+    const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    return float4(_mm_and_ps(_mm_mul_ps(v.m, rsqrt(dot3v(v, v)).m), xyz));
+#else
+    float4 n = v * rsqrt(dot3v(v, v));
+    n.w = 0;
+    return n;
+#endif
+}
+
+#endif
@@ -0,0 +1,316 @@
+// 8-wide float vector for shading batches of hits together
+// uses AVX2 when built for it, and pairs of float4 everywhere else
+#ifndef FLOAT8_HPP
+#define FLOAT8_HPP
+
+#include "float4.hpp"
+
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#define FLOAT8_AVX 1
+#include <immintrin.h>
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// 32-byte aligned vector of 8 lanes, each usually the same quantity for a
+// different hit, as in one coordinate of 8 points
+// comparisons give masks, with every bit of a lane set where true, for
+// select and bits
+struct alignas(32) float8 {
+    union {
+#if FLOAT8_AVX
+        __m256 m;
+#endif
+        float4 h[2];
+        float f[8];
+    };
+
+public: // constructors
+    float8() { h[0] = float4(); h[1] = float4(); }
+    float8(const float4 &lo, const float4 &hi) { h[0] = lo; h[1] = hi; }
+#if FLOAT8_AVX
+    typedef __m256 native;
+    explicit float8(native _m) { m = _m; }
+#endif
+    // also can use default copy constructor
+
+    // splat one value across all eight lanes
+    static float8 splat(float s) {
+#if FLOAT8_AVX
+        return float8(_mm256_set1_ps(s));
+#else
+        return float8(float4::splat(s), float4::splat(s));
+#endif
+    }
+
+    // 8 floats from p, which needn't be aligned
+    static float8 load(const float *p) {
+#if FLOAT8_AVX
+        return float8(_mm256_loadu_ps(p));
+#else
+        float8 v;
+        memcpy(v.f, p, sizeof(v.f));
+        return v;
+#endif
+    }
+
+public:
+    // 8 floats to p, which needn't be aligned
+    void store(float *p) const {
+#if FLOAT8_AVX
+        _mm256_storeu_ps(p, m);
+#else
+        memcpy(p, f, sizeof(f));
+#endif
+    }
+
+    float operator[](int i) const { return f[i]; }
+    float &operator[](int i) { return f[i]; }
+};
+
+//////////////////////////////
+// component-wise operations: -v, v1+v2, v1-v2, v1*v2, v1/v2, min, max
+// operations with a scalar: s*v, v*s
+// v1<v2 and v1>v2 masks, select, bits
+// per-lane functions: sqrt, rsqrt, floor, log, exp, pow
+
+inline float8 operator+(const float8 &v1, const float8 &v2) {
+#if FLOAT8_AVX
+    return float8(_mm256_add_ps(v1.m, v2.m));
+#else
+    return float8(v1.h[0] + v2.h[0], v1.h[1] + v2.h[1]);
+#endif
+}
+
+inline float8 operator-(const float8 &v1, const float8 &v2) {
+#if FLOAT8_AVX
+    return float8(_mm256_sub_ps(v1.m, v2.m));
+#else
+    return float8(v1.h[0] - v2.h[0], v1.h[1] - v2.h[1]);
+#endif
+}
+
+inline float8 operator*(const float8 &v1, const float8 &v2) {
+#if FLOAT8_AVX
+    return float8(_mm256_mul_ps(v1.m, v2.m));
+#else
+    return float8(v1.h[0] * v2.h[0], v1.h[1] * v2.h[1]);
+#endif
+}
+
+inline float8 operator/(const float8 &v1, const float8 &v2) {
+#if FLOAT8_AVX
+    return float8(_mm256_div_ps(v1.m, v2.m));
+#else
+    return float8(v1.h[0] / v2.h[0], v1.h[1] / v2.h[1]);
+#endif
+}
+
+inline float8 operator-(const float8 &v) {
+#if FLOAT8_AVX
+    return float8(_mm256_sub_ps(_mm256_setzero_ps(), v.m));
+#else
+    return float8(-v.h[0], -v.h[1]);
+#endif
+}
+
+inline float8 operator*(float s, const float8 &v) { return float8::splat(s) * v; }
+inline float8 operator*(const float8 &v, float s) { return v * float8::splat(s); }
+
+// component-wise minimum and maximum
+inline float8 min(const float8 &v1, const float8 &v2) {
+#if FLOAT8_AVX
+    return float8(_mm256_min_ps(v1.m, v2.m));
+#else
+    return float8(min(v1.h[0], v2.h[0]), min(v1.h[1], v2.h[1]));
+#endif
+}
+
+inline float8 max(const float8 &v1, const float8 &v2) {
+#if FLOAT8_AVX
+    return float8(_mm256_max_ps(v1.m, v2.m));
+#else
+    return float8(max(v1.h[0], v2.h[0]), max(v1.h[1], v2.h[1]));
+#endif
+}
+
+// lane masks for v1<v2 and v1>v2, false where either is NaN
+inline float8 operator<(const float8 &v1, const float8 &v2) {
+#if FLOAT8_AVX
+    return float8(_mm256_cmp_ps(v1.m, v2.m, _CMP_LT_OQ));
+#else
+    float8 mask;
+    for (int i = 0; i < 8; ++i) {
+        uint32_t all = v1.f[i] < v2.f[i] ? ~0u : 0u;
+        memcpy(&mask.f[i], &all, sizeof(all));
+    }
+    return mask;
+#endif
+}
+
+inline float8 operator>(const float8 &v1, const float8 &v2) {
+    return v2 < v1;
+}
+
+// a in lanes where mask is set, b in the rest
+inline float8 select(const float8 &mask, const float8 &a, const float8 &b) {
+#if FLOAT8_AVX
+    return float8(_mm256_blendv_ps(b.m, a.m, mask.m));
+#else
+    float8 v;
+    for (int i = 0; i < 8; ++i) {
+        uint32_t m, x, y;
+        memcpy(&m, &mask.f[i], sizeof(m));
+        memcpy(&x, &a.f[i], sizeof(x));
+        memcpy(&y, &b.f[i], sizeof(y));
+        x = (x & m) | (y & ~m);
+        memcpy(&v.f[i], &x, sizeof(x));
+    }
+    return v;
+#endif
+}
+
+// one bit per lane of mask, lane 0 in bit 0
+inline int bits(const float8 &mask) {
+#if FLOAT8_AVX
+    return _mm256_movemask_ps(mask.m);
+#else
+    int set = 0;
+    for (int i = 0; i < 8; ++i)
+        set |= int(signbit(mask.f[i]) != 0) << i;
+    return set;
+#endif
+}
+
+inline float8 sqrt(const float8 &v) {
+#if FLOAT8_AVX
+    return float8(_mm256_sqrt_ps(v.m));
+#else
+    float8 r;
+    for (int i = 0; i < 8; ++i)
+        r.f[i] = sqrtf(v.f[i]);
+    return r;
+#endif
+}
+
+// approximate 1/sqrt(v), refined with one Newton step as float4's rsqrt
+inline float8 rsqrt(const float8 &v) {
+#if FLOAT8_AVX
+    __m256 y = _mm256_rsqrt_ps(v.m);
+    __m256 hxyy = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), v.m), _mm256_mul_ps(y, y));
+    return float8(_mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), hxyy)));
+#else
+    return float8(rsqrt(v.h[0]), rsqrt(v.h[1]));
+#endif
+}
+
+inline float8 floor(const float8 &v) {
+#if FLOAT8_AVX
+    return float8(_mm256_floor_ps(v.m));
+#else
+    float8 r;
+    for (int i = 0; i < 8; ++i)
+        r.f[i] = floorf(v.f[i]);
+    return r;
+#endif
+}
+
+// split positive, normal v into mantissas in [0.5,1), returned, and the
+// powers of 2 they're scaled by, in e
+inline float8 frexp(const float8 &v, float8 &e) {
+#if FLOAT8_AVX
+    __m256i i = _mm256_castps_si256(v.m);
+    e = float8(_mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(i, 23),
+                                                   _mm256_set1_epi32(126))));
+    i = _mm256_or_si256(_mm256_and_si256(i, _mm256_set1_epi32(0x807fffff)),
+                        _mm256_set1_epi32(0x3f000000));
+    return float8(_mm256_castsi256_ps(i));
+#else
+    float8 r;
+    for (int k = 0; k < 8; ++k) {
+        uint32_t i;
+        memcpy(&i, &v.f[k], sizeof(i));
+        e.f[k] = float(int(i >> 23) - 126);
+        i = (i & 0x807fffffu) | 0x3f000000u;
+        memcpy(&r.f[k], &i, sizeof(i));
+    }
+    return r;
+#endif
+}
+
+// 2 to the power of integer-valued n, for n from -126 to 127
+inline float8 exp2i(const float8 &n) {
+#if FLOAT8_AVX
+    __m256i i = _mm256_add_epi32(_mm256_cvttps_epi32(n.m), _mm256_set1_epi32(127));
+    return float8(_mm256_castsi256_ps(_mm256_slli_epi32(i, 23)));
+#else
+    float8 r;
+    for (int k = 0; k < 8; ++k) {
+        uint32_t i = uint32_t(int(n.f[k]) + 127) << 23;
+        memcpy(&r.f[k], &i, sizeof(i));
+    }
+    return r;
+#endif
+}
+
+// natural log for v > 0, with the Cephes logf polynomial, accurate to
+// about 1e-7 relative; lanes below the smallest normal float are clamped
+// to it rather than going to -infinity
+inline float8 log(const float8 &v) {
+    float8 e, one = float8::splat(1);
+    float8 x = frexp(max(v, float8::splat(1.17549435e-38f)), e);
+
+    // mantissa in [sqrt(1/2), sqrt(2)), less 1
+    float8 small = x < float8::splat(0.707106781186547524f);
+    e = e - select(small, one, float8());
+    x = x - one + select(small, x, float8());
+
+    float8 z = x * x;
+    float8 y = float8::splat(7.0376836292e-2f);
+    y = y * x + float8::splat(-1.1514610310e-1f);
+    y = y * x + float8::splat(1.1676998740e-1f);
+    y = y * x + float8::splat(-1.2420140846e-1f);
+    y = y * x + float8::splat(1.4249322787e-1f);
+    y = y * x + float8::splat(-1.6668057665e-1f);
+    y = y * x + float8::splat(2.0000714765e-1f);
+    y = y * x + float8::splat(-2.4999993993e-1f);
+    y = y * x + float8::splat(3.3333331174e-1f);
+    y = y * x * z;
+
+    // ln 2 in two parts, so e*ln 2 keeps its precision
+    y = y + e * float8::splat(-2.12194440e-4f);
+    y = y - float8::splat(0.5f) * z;
+    return x + y + e * float8::splat(0.693359375f);
+}
+
+// e to the power v, with the Cephes expf polynomial, accurate to about
+// 1e-7 relative; lanes are clamped to +/-88.37, so the smallest gives 0
+inline float8 exp(const float8 &v) {
+    float8 x = min(max(v, float8::splat(-88.3762626647949f)),
+                   float8::splat(88.3762626647949f));
+
+    // v = n ln 2 + x, with x in [-ln 2/2, ln 2/2]
+    float8 n = floor(x * float8::splat(1.44269504088896341f) + float8::splat(0.5f));
+    x = x - n * float8::splat(0.693359375f);
+    x = x - n * float8::splat(-2.12194440e-4f);
+
+    float8 z = x * x;
+    float8 y = float8::splat(1.9875691500e-4f);
+    y = y * x + float8::splat(1.3981999507e-3f);
+    y = y * x + float8::splat(8.3334519073e-3f);
+    y = y * x + float8::splat(4.1665795894e-2f);
+    y = y * x + float8::splat(1.6666665459e-1f);
+    y = y * x + float8::splat(5.0000001201e-1f);
+    y = y * z + x + float8::splat(1);
+    return y * exp2i(n);
+}
+
+// b to the power e for b > 0, as exp(e log b), so the relative error is
+// about 1e-7 times |e log b|, which is small wherever the result isn't
+inline float8 pow(const float8 &b, const float8 &e) {
+    return exp(e * log(b));
+}
+
+#endif
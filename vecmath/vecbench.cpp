@@ -0,0 +1,162 @@
+// microbenchmarks comparing float4 against the vector classes it replaces
+// build in Release mode for meaningful numbers
+
+#include "float4.hpp"
+#include "float8.hpp"
+
+// standard includes
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <stdlib.h>
+
+//////////////////////////////////////////////////////////////////////
+// original raysample Vec3: float data[3], sqrt and divide to normalize
+struct OldVec3 {
+    float data[3];
+    OldVec3() { data[0] = data[1] = data[2] = 0; }
+    OldVec3(float x, float y, float z) { data[0] = x; data[1] = y; data[2] = z; }
+    float operator[](int i) const { return data[i]; }
+};
+inline OldVec3 operator+(const OldVec3 &a, const OldVec3 &b) {
+    return OldVec3(a[0]+b[0], a[1]+b[1], a[2]+b[2]);
+}
+inline OldVec3 operator*(float s, const OldVec3 &v) {
+    return OldVec3(s*v[0], s*v[1], s*v[2]);
+}
+inline float dot(const OldVec3 &a, const OldVec3 &b) {
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+inline OldVec3 cross(const OldVec3 &a, const OldVec3 &b) {
+    return OldVec3(a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0]);
+}
+inline OldVec3 normalize(const OldVec3 &v) {
+    return (1/sqrtf(dot(v,v))) * v;
+}
+
+//////////////////////////////////////////////////////////////////////
+// original trace Vector3D: pow for length, length() three times to normalize
+struct OldVector3D {
+    float x, y, z;
+    OldVector3D() : x(0), y(0), z(0) {}
+    OldVector3D(float x, float y, float z) : x(x), y(y), z(z) {}
+    OldVector3D operator+(OldVector3D v) { return OldVector3D(x + v.x, y + v.y, z + v.z); }
+    float length() { return sqrt(pow(x, 2) + pow(y, 2) + pow(z, 2)); }
+    OldVector3D normalization() { return OldVector3D(x / length(), y / length(), z / length()); }
+    OldVector3D crossProduct(OldVector3D v) {
+        return OldVector3D(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
+    }
+    float dotProduct(OldVector3D v) { return x * v.x + y * v.y + z * v.z; }
+};
+
+//////////////////////////////////////////////////////////////////////
+// timing harness
+
+static const int Count = 4096;      // vectors per array, small enough to stay in L1/L2
+static const int Mask = Count-1;
+static const int Reps = 2000;       // passes over the arrays
+
+static float frand() { return float(rand()) / RAND_MAX * 2 - 1; }
+
+// run f Reps times, print ns per vector and return the checksum so the
+// compiler can't drop the work. f gets the pass number to offset its
+// second operand, so passes can't be hoisted out of the loop either
+template <typename F>
+static float bench(const char *name, F f) {
+    float sum = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < Reps; ++r)
+        sum += f(r);
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    std::cout << "  " << name << ": " << elapsed.count() / (double(Reps) * Count)
+        << " ns/op\n";
+    return sum;
+}
+
+int main()
+{
+    std::vector<OldVec3> av(Count), bv(Count), ov(Count);
+    std::vector<OldVector3D> at(Count), bt(Count), ot(Count);
+    std::vector<float4> a4(Count), b4(Count), o4(Count);
+    std::vector<float> os(Count);
+    for (int i = 0; i < Count; ++i) {
+        float x = frand(), y = frand(), z = frand();
+        float p = frand(), q = frand(), s = frand();
+        av[i] = OldVec3(x, y, z);       bv[i] = OldVec3(p, q, s);
+        at[i] = OldVector3D(x, y, z);   bt[i] = OldVector3D(p, q, s);
+        a4[i] = float4(x, y, z);        b4[i] = float4(p, q, s);
+    }
+
+    float check = 0;
+
+    std::cout << "dot\n";
+    check += bench("raysample Vec3 ", [&](int r) {
+        for (int i = 0; i < Count; ++i) os[i] = dot(av[i], bv[(i+r) & Mask]);
+        return os[r & Mask]; });
+    check += bench("trace Vector3D ", [&](int r) {
+        for (int i = 0; i < Count; ++i) os[i] = at[i].dotProduct(bt[(i+r) & Mask]);
+        return os[r & Mask]; });
+    check += bench("float4         ", [&](int r) {
+        for (int i = 0; i < Count; ++i) os[i] = dot3(a4[i], b4[(i+r) & Mask]);
+        return os[r & Mask]; });
+
+    std::cout << "cross\n";
+    check += bench("raysample Vec3 ", [&](int r) {
+        for (int i = 0; i < Count; ++i) ov[i] = cross(av[i], bv[(i+r) & Mask]);
+        return ov[r & Mask][0]; });
+    check += bench("trace Vector3D ", [&](int r) {
+        for (int i = 0; i < Count; ++i) ot[i] = at[i].crossProduct(bt[(i+r) & Mask]);
+        return ot[r & Mask].x; });
+    check += bench("float4         ", [&](int r) {
+        for (int i = 0; i < Count; ++i) o4[i] = cross3(a4[i], b4[(i+r) & Mask]);
+        return o4[r & Mask].x; });
+
+    std::cout << "normalize\n";
+    check += bench("raysample Vec3 ", [&](int r) {
+        for (int i = 0; i < Count; ++i) ov[i] = normalize(av[(i+r) & Mask]);
+        return ov[r & Mask][0]; });
+    check += bench("trace Vector3D ", [&](int r) {
+        for (int i = 0; i < Count; ++i) ot[i] = at[(i+r) & Mask].normalization();
+        return ot[r & Mask].x; });
+    check += bench("float4         ", [&](int r) {
+        for (int i = 0; i < Count; ++i) o4[i] = normalize3(a4[(i+r) & Mask]);
+        return o4[r & Mask].x; });
+
+    std::cout << "fma, min, max\n";
+    check += bench("raysample Vec3 ", [&](int r) {
+        for (int i = 0; i < Count; ++i) {
+            const OldVec3 &a = av[i], &b = bv[(i+r) & Mask];
+            OldVec3 m = 0.5f * a + b;
+            ov[i] = OldVec3(fmaxf(fminf(m[0], b[0]), a[0]),
+                            fmaxf(fminf(m[1], b[1]), a[1]),
+                            fmaxf(fminf(m[2], b[2]), a[2]));
+        }
+        return ov[r & Mask][0]; });
+    check += bench("float4         ", [&](int r) {
+        float4 h = float4::splat(0.5f);
+        for (int i = 0; i < Count; ++i) {
+            const float4 &a = a4[i], &b = b4[(i+r) & Mask];
+            float4 m = fma(h, a, b);
+            o4[i] = max(min(m, b), a);
+        }
+        return o4[r & Mask].x; });
+
+    std::cout << "pow, 8 at a time\n";
+    std::vector<float> base(Count), power(Count);
+    for (int i = 0; i < Count; ++i) {
+        base[i] = fabsf(frand());
+        power[i] = 100 * fabsf(frand());
+    }
+    check += bench("powf           ", [&](int r) {
+        for (int i = 0; i < Count; ++i) os[i] = powf(base[i], power[(i+r) & Mask]);
+        return os[r & Mask]; });
+    check += bench("float8         ", [&](int r) {
+        for (int i = 0; i < Count; i += 8)
+            pow(float8::load(&base[i]), float8::load(&power[(i+r) & Mask & ~7])).store(&os[i]);
+        return os[r & Mask]; });
+
+    std::cout << "(checksum " << check << ")\n";
+    return 0;
+}